@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include "imagecodec.h"
+
+namespace {
+
+struct Pixel {
+    std::uint8_t r = 0, g = 0, b = 0, a = 255;
+    bool operator==(const Pixel &o) const { return r==o.r && g==o.g && b==o.b && a==o.a; }
+};
+
+inline int qoi_hash(const Pixel &p) { return (p.r*3 + p.g*5 + p.b*7 + p.a*11) % 64; }
+
+// TGAImage stores BGR(A) or gray bytes.
+inline Pixel load_pixel(const std::uint8_t *p, int bpp) {
+    if (bpp==TGAImage::GRAYSCALE) return {p[0], p[0], p[0], 255};
+    return {p[2], p[1], p[0], static_cast<std::uint8_t>(bpp==TGAImage::RGBA ? p[3] : 255)};
+}
+
+inline void store_pixel(std::uint8_t *p, int bpp, const Pixel &px) {
+    p[0] = px.b; p[1] = px.g; p[2] = px.r;
+    if (bpp==TGAImage::RGBA) p[3] = px.a;
+}
+
+inline void put_u32_be(std::vector<std::uint8_t> &out, std::uint32_t v) {
+    out.push_back(v>>24); out.push_back(v>>16); out.push_back(v>>8); out.push_back(v);
+}
+
+inline std::uint32_t get_u32_be(const std::uint8_t *p) {
+    return (std::uint32_t(p[0])<<24) | (std::uint32_t(p[1])<<16) | (std::uint32_t(p[2])<<8) | p[3];
+}
+
+// Decoders fail on data that ends before the last pixel rather than return a partial image.
+bool qoi_truncated() {
+    std::cerr << "truncated qoi data\n";
+    return false;
+}
+
+const std::uint8_t *image_row(const TGAImage &img, int y, bool vflip) {
+    int row = vflip ? img.height()-1-y : y;
+    return img.framebuffer_ptr() + size_t(row)*img.width()*img.get_bpp();
+}
+
+constexpr std::uint8_t QOI_OP_INDEX = 0x00;
+constexpr std::uint8_t QOI_OP_DIFF  = 0x40;
+constexpr std::uint8_t QOI_OP_LUMA  = 0x80;
+constexpr std::uint8_t QOI_OP_RUN   = 0xc0;
+constexpr std::uint8_t QOI_OP_RGB   = 0xfe;
+constexpr std::uint8_t QOI_OP_RGBA  = 0xff;
+constexpr std::uint8_t QOI_MASK     = 0xc0;
+constexpr std::uint8_t qoi_padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+std::array<std::uint32_t, 256> make_crc_table() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t n=0; n<256; n++) {
+        std::uint32_t c = n;
+        for (int k=0; k<8; k++)
+            c = (c&1) ? 0xedb88320u ^ (c>>1) : c>>1;
+        table[n] = c;
+    }
+    return table;
+}
+
+std::uint32_t crc32(const std::uint8_t *p, size_t n) {
+    static const std::array<std::uint32_t, 256> table = make_crc_table();
+    std::uint32_t c = 0xffffffffu;
+    for (size_t i=0; i<n; i++)
+        c = table[(c^p[i])&0xff] ^ (c>>8);
+    return c ^ 0xffffffffu;
+}
+
+std::uint32_t adler32(const std::uint8_t *p, size_t n) {
+    constexpr std::uint32_t mod = 65521, nmax = 5552; // largest block without 32-bit overflow
+    std::uint32_t a = 1, b = 0;
+    while (n) {
+        size_t block = std::min<size_t>(n, nmax);
+        n -= block;
+        for (size_t i=0; i<block; i++) {
+            a += p[i];
+            b += a;
+        }
+        p += block;
+        a %= mod;
+        b %= mod;
+    }
+    return (b<<16) | a;
+}
+
+void png_chunk(std::vector<std::uint8_t> &out, const char type[4], const std::uint8_t *payload, size_t n) {
+    put_u32_be(out, static_cast<std::uint32_t>(n));
+    size_t start = out.size();
+    out.insert(out.end(), type, type+4);
+    out.insert(out.end(), payload, payload+n);
+    put_u32_be(out, crc32(out.data()+start, n+4));
+}
+
+inline std::uint8_t paeth(int a, int b, int c) {
+    int p = a+b-c, pa = std::abs(p-a), pb = std::abs(p-b), pc = std::abs(p-c);
+    if (pa<=pb && pa<=pc) return a;
+    return pb<=pc ? b : c;
+}
+
+bool read_file(const std::string &filename, std::vector<std::uint8_t> &out) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    in.seekg(0, std::ios::end);
+    out.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0, std::ios::beg);
+    in.read(reinterpret_cast<char *>(out.data()), out.size());
+    return in.good();
+}
+
+bool write_file(const std::string &filename, const std::vector<std::uint8_t> &data) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    if (!out.good()) {
+        std::cerr << "can't dump the image file\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+ImageFormat image_format_from_path(const std::string &filename) {
+    size_t dot = filename.find_last_of('.');
+    if (dot==std::string::npos) return ImageFormat::UNKNOWN;
+    std::string ext = filename.substr(dot+1);
+    for (auto &c : ext) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (ext=="tga") return ImageFormat::TGA;
+    if (ext=="qoi") return ImageFormat::QOI;
+    if (ext=="png") return ImageFormat::PNG;
+    return ImageFormat::UNKNOWN;
+}
+
+void encode_qoi(const TGAImage &img, std::vector<std::uint8_t> &out, const bool vflip) {
+    const int w = img.width(), h = img.height(), bpp = img.get_bpp();
+    const int channels = bpp==TGAImage::RGBA ? 4 : 3;
+    out.clear();
+    out.reserve(14 + size_t(w)*h*(channels+1) + sizeof(qoi_padding));
+    for (char c : {'q', 'o', 'i', 'f'}) out.push_back(c);
+    put_u32_be(out, w);
+    put_u32_be(out, h);
+    out.push_back(channels);
+    out.push_back(0); // sRGB with linear alpha
+
+    Pixel index[64] = {};
+    for (auto &p : index) p.a = 0;
+    Pixel prev;
+    int run = 0;
+    const size_t npixels = size_t(w)*h;
+    size_t n = 0;
+    for (int y=0; y<h; y++) {
+        const std::uint8_t *row = image_row(img, y, vflip);
+        for (int x=0; x<w; x++, n++) {
+            Pixel px = load_pixel(row+x*bpp, bpp);
+            if (px==prev) {
+                if (++run==62 || n+1==npixels) {
+                    out.push_back(QOI_OP_RUN | (run-1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run>0) {
+                out.push_back(QOI_OP_RUN | (run-1));
+                run = 0;
+            }
+            int idx = qoi_hash(px);
+            if (index[idx]==px) {
+                out.push_back(QOI_OP_INDEX | idx);
+            } else {
+                index[idx] = px;
+                if (px.a==prev.a) {
+                    int vr = static_cast<std::int8_t>(px.r-prev.r);
+                    int vg = static_cast<std::int8_t>(px.g-prev.g);
+                    int vb = static_cast<std::int8_t>(px.b-prev.b);
+                    int vg_r = vr-vg, vg_b = vb-vg;
+                    if (vr>-3 && vr<2 && vg>-3 && vg<2 && vb>-3 && vb<2) {
+                        out.push_back(QOI_OP_DIFF | (vr+2)<<4 | (vg+2)<<2 | (vb+2));
+                    } else if (vg_r>-9 && vg_r<8 && vg>-33 && vg<32 && vg_b>-9 && vg_b<8) {
+                        out.push_back(QOI_OP_LUMA | (vg+32));
+                        out.push_back((vg_r+8)<<4 | (vg_b+8));
+                    } else {
+                        out.insert(out.end(), {QOI_OP_RGB, px.r, px.g, px.b});
+                    }
+                } else {
+                    out.insert(out.end(), {QOI_OP_RGBA, px.r, px.g, px.b, px.a});
+                }
+            }
+            prev = px;
+        }
+    }
+    out.insert(out.end(), qoi_padding, qoi_padding+sizeof(qoi_padding));
+}
+
+bool decode_qoi(TGAImage &img, const std::vector<std::uint8_t> &in) {
+    if (in.size()<14+sizeof(qoi_padding) || std::memcmp(in.data(), "qoif", 4)) {
+        std::cerr << "not a qoi file\n";
+        return false;
+    }
+    const std::uint32_t w = get_u32_be(in.data()+4), h = get_u32_be(in.data()+8);
+    const int channels = in[12];
+    if (!w || !h || w>65535 || h>65535 || (channels!=3 && channels!=4)) {
+        std::cerr << "bad qoi header\n";
+        return false;
+    }
+    const int bpp = channels==4 ? TGAImage::RGBA : TGAImage::RGB;
+    img = TGAImage(w, h, bpp);
+    std::uint8_t *data = img.framebuffer_ptr();
+
+    Pixel index[64] = {};
+    for (auto &p : index) p.a = 0;
+    Pixel px;
+    int run = 0;
+    size_t pos = 14;
+    const size_t end = in.size()-sizeof(qoi_padding);
+    const size_t npixels = size_t(w)*h;
+    for (size_t n=0; n<npixels; n++) {
+        if (run>0) {
+            run--;
+        } else if (pos<end) {
+            std::uint8_t b1 = in[pos++];
+            if (b1==QOI_OP_RGB) {
+                if (pos+3>end) return qoi_truncated();
+                px.r = in[pos++]; px.g = in[pos++]; px.b = in[pos++];
+            } else if (b1==QOI_OP_RGBA) {
+                if (pos+4>end) return qoi_truncated();
+                px.r = in[pos++]; px.g = in[pos++]; px.b = in[pos++]; px.a = in[pos++];
+            } else if ((b1&QOI_MASK)==QOI_OP_INDEX) {
+                px = index[b1];
+            } else if ((b1&QOI_MASK)==QOI_OP_DIFF) {
+                px.r += ((b1>>4)&0x03)-2;
+                px.g += ((b1>>2)&0x03)-2;
+                px.b += (b1&0x03)-2;
+            } else if ((b1&QOI_MASK)==QOI_OP_LUMA) {
+                if (pos+1>end) return qoi_truncated();
+                std::uint8_t b2 = in[pos++];
+                int vg = (b1&0x3f)-32;
+                px.r += vg-8+((b2>>4)&0x0f);
+                px.g += vg;
+                px.b += vg-8+(b2&0x0f);
+            } else {
+                run = b1&0x3f;
+            }
+            index[qoi_hash(px)] = px;
+        } else {
+            return qoi_truncated();
+        }
+        store_pixel(data+n*bpp, bpp, px);
+    }
+    return true;
+}
+
+void encode_png(const TGAImage &img, std::vector<std::uint8_t> &out, const bool vflip) {
+    const int w = img.width(), h = img.height(), bpp = img.get_bpp();
+    const int channels = bpp==TGAImage::GRAYSCALE ? 1 : bpp;
+    const size_t row_bytes = 1+size_t(w)*channels; // filter byte + pixels
+
+    // Filtered scanlines (filter type 0), RGB(A) order.
+    std::vector<std::uint8_t> raw(row_bytes*h);
+    for (int y=0; y<h; y++) {
+        const std::uint8_t *src = image_row(img, y, vflip);
+        std::uint8_t *dst = raw.data()+y*row_bytes;
+        *dst++ = 0;
+        if (channels==1) {
+            std::memcpy(dst, src, w);
+            continue;
+        }
+        for (int x=0; x<w; x++, src+=bpp, dst+=channels) {
+            dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0];
+            if (channels==4) dst[3] = src[3];
+        }
+    }
+
+    // zlib stream made of stored deflate blocks.
+    constexpr size_t max_block = 65535;
+    std::vector<std::uint8_t> zlib;
+    zlib.reserve(raw.size() + (raw.size()/max_block+1)*5 + 6);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t pos = 0;
+    do {
+        size_t len = std::min(max_block, raw.size()-pos);
+        bool final = pos+len==raw.size();
+        zlib.push_back(final ? 1 : 0);
+        zlib.push_back(len&0xff); zlib.push_back(len>>8);
+        zlib.push_back(~len&0xff); zlib.push_back((~len>>8)&0xff);
+        zlib.insert(zlib.end(), raw.begin()+pos, raw.begin()+pos+len);
+        pos += len;
+    } while (pos<raw.size());
+    put_u32_be(zlib, adler32(raw.data(), raw.size()));
+
+    static const std::uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<std::uint8_t> ihdr;
+    put_u32_be(ihdr, w);
+    put_u32_be(ihdr, h);
+    ihdr.insert(ihdr.end(), {8, static_cast<std::uint8_t>(channels==1 ? 0 : channels==3 ? 2 : 6), 0, 0, 0});
+
+    out.clear();
+    out.reserve(zlib.size()+64);
+    out.insert(out.end(), signature, signature+8);
+    png_chunk(out, "IHDR", ihdr.data(), ihdr.size());
+    png_chunk(out, "IDAT", zlib.data(), zlib.size());
+    png_chunk(out, "IEND", nullptr, 0);
+}
+
+bool decode_png(TGAImage &img, const std::vector<std::uint8_t> &in) {
+    static const std::uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (in.size()<8 || std::memcmp(in.data(), signature, 8)) {
+        std::cerr << "not a png file\n";
+        return false;
+    }
+    std::uint32_t w = 0, h = 0;
+    int channels = 0;
+    std::vector<std::uint8_t> zlib;
+    for (size_t pos=8; pos+12<=in.size();) {
+        std::uint32_t len = get_u32_be(in.data()+pos);
+        const std::uint8_t *type = in.data()+pos+4;
+        const std::uint8_t *payload = type+4;
+        if (pos+12+size_t(len)>in.size()) break;
+        if (!std::memcmp(type, "IHDR", 4) && len>=13) {
+            w = get_u32_be(payload);
+            h = get_u32_be(payload+4);
+            int color = payload[9];
+            channels = color==0 ? 1 : color==2 ? 3 : color==6 ? 4 : 0;
+            if (payload[8]!=8 || !channels || payload[12]!=0) {
+                std::cerr << "unsupported png pixel format\n";
+                return false;
+            }
+        } else if (!std::memcmp(type, "IDAT", 4)) {
+            zlib.insert(zlib.end(), payload, payload+len);
+        } else if (!std::memcmp(type, "IEND", 4)) {
+            break;
+        }
+        pos += 12+size_t(len);
+    }
+    if (!w || !h || w>65535 || h>65535 || zlib.size()<2) {
+        std::cerr << "bad png header\n";
+        return false;
+    }
+
+    std::vector<std::uint8_t> raw;
+    size_t pos = 2;
+    for (bool final=false; !final;) {
+        if (pos+5>zlib.size() || (zlib[pos]&0x06)) {
+            std::cerr << "only uncompressed (stored) png data is supported\n";
+            return false;
+        }
+        final = zlib[pos]&1;
+        size_t len = zlib[pos+1] | (zlib[pos+2]<<8);
+        pos += 5;
+        if (pos+len>zlib.size()) {
+            std::cerr << "truncated png data\n";
+            return false;
+        }
+        raw.insert(raw.end(), zlib.begin()+pos, zlib.begin()+pos+len);
+        pos += len;
+    }
+    const size_t row_bytes = size_t(w)*channels;
+    if (raw.size()<(row_bytes+1)*h) {
+        std::cerr << "truncated png data\n";
+        return false;
+    }
+
+    const int bpp = channels==1 ? TGAImage::GRAYSCALE : channels;
+    img = TGAImage(w, h, bpp);
+    std::vector<std::uint8_t> prev(row_bytes, 0), cur(row_bytes);
+    for (std::uint32_t y=0; y<h; y++) {
+        const std::uint8_t *src = raw.data()+y*(row_bytes+1);
+        std::uint8_t filter = *src++;
+        for (size_t i=0; i<row_bytes; i++) {
+            int a = i>=size_t(channels) ? cur[i-channels] : 0;
+            int b = prev[i];
+            int c = i>=size_t(channels) ? prev[i-channels] : 0;
+            int pred = 0;
+            switch (filter) {
+                case 0: pred = 0; break;
+                case 1: pred = a; break;
+                case 2: pred = b; break;
+                case 3: pred = (a+b)/2; break;
+                case 4: pred = paeth(a, b, c); break;
+                default:
+                    std::cerr << "bad png filter type\n";
+                    return false;
+            }
+            cur[i] = static_cast<std::uint8_t>(src[i]+pred);
+        }
+        std::uint8_t *dst = img.framebuffer_ptr()+size_t(y)*w*bpp;
+        if (channels==1) {
+            std::memcpy(dst, cur.data(), w);
+        } else {
+            for (std::uint32_t x=0; x<w; x++) {
+                const std::uint8_t *p = cur.data()+x*channels;
+                store_pixel(dst+x*bpp, bpp, {p[0], p[1], p[2], static_cast<std::uint8_t>(channels==4 ? p[3] : 255)});
+            }
+        }
+        std::swap(prev, cur);
+    }
+    return true;
+}
+
+bool write_image(const TGAImage &img, const std::string &filename, const bool vflip) {
+    std::vector<std::uint8_t> encoded;
+    switch (image_format_from_path(filename)) {
+        case ImageFormat::TGA: return img.write_tga_file(filename, vflip);
+        case ImageFormat::QOI: encode_qoi(img, encoded, vflip); break;
+        case ImageFormat::PNG: encode_png(img, encoded, vflip); break;
+        default:
+            std::cerr << "unknown image format " << filename << "\n";
+            return false;
+    }
+    return write_file(filename, encoded);
+}
+
+bool read_image(TGAImage &img, const std::string &filename) {
+    ImageFormat format = image_format_from_path(filename);
+    if (format==ImageFormat::TGA) return img.read_tga_file(filename);
+    if (format==ImageFormat::UNKNOWN) {
+        std::cerr << "unknown image format " << filename << "\n";
+        return false;
+    }
+    std::vector<std::uint8_t> file;
+    if (!read_file(filename, file)) return false;
+    return format==ImageFormat::QOI ? decode_qoi(img, file) : decode_png(img, file);
+}
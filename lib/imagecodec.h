@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tgaimage.h"
+
+// Image codecs next to the TGA writer:
+//  - QOI (https://qoiformat.org), lossless and much faster to encode than zlib;
+//  - PNG with stored (uncompressed) deflate blocks, for tools that only read PNG.
+// QOI has no grayscale mode, so it expands grayscale images to RGB; PNG
+// stores them as grayscale (color type 0). Like write_tga_file, vflip=true means
+// row 0 of the image is the bottom row; decoders return row 0 as the top row,
+// the same as read_tga_file.
+
+enum class ImageFormat { TGA, QOI, PNG, UNKNOWN };
+
+// Picks the format from the file extension (case-insensitive).
+ImageFormat image_format_from_path(const std::string &filename);
+
+void encode_qoi(const TGAImage &img, std::vector<std::uint8_t> &out, const bool vflip=true);
+bool decode_qoi(TGAImage &img, const std::vector<std::uint8_t> &in);
+
+void encode_png(const TGAImage &img, std::vector<std::uint8_t> &out, const bool vflip=true);
+// Only PNGs with stored deflate blocks (as written by encode_png) are supported.
+bool decode_png(TGAImage &img, const std::vector<std::uint8_t> &in);
+
+// Format is selected by extension: .tga, .qoi or .png.
+bool write_image(const TGAImage &img, const std::string &filename, const bool vflip=true);
+bool read_image(TGAImage &img, const std::string &filename);
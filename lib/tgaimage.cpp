@@ -1,7 +1,80 @@
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <thread>
+#include <utility>
 #include "tgaimage.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TGA_USE_SSE2 1
+#endif
+
+namespace {
+
+int parallel_concurrency = 0; // 0: hardware_concurrency
+TGAParallelFor parallel_for;
+
+void append(std::vector<std::uint8_t> &out, const void *src, size_t n) {
+    const size_t size = out.size();
+    out.resize(size+n);
+    if (n) std::memcpy(out.data()+size, src, n);
+}
+
+// Index of the first byte where a and b differ, or n if the ranges are equal.
+size_t first_mismatch(const std::uint8_t *a, const std::uint8_t *b, size_t n) {
+    size_t i = 0;
+#ifdef TGA_USE_SSE2
+    for (; i+16<=n; i+=16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a+i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b+i));
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) & 0xFFFFu;
+        if (mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+            return i+bit;
+#else
+            return i+__builtin_ctz(mask);
+#endif
+        }
+    }
+#endif
+    for (; i<n; i++)
+        if (a[i]!=b[i]) return i;
+    return n;
+}
+
+// Encodes one scanline of npix pixels as TGA RLE packets (at most 128 pixels each).
+void encode_rle_row(const std::uint8_t *row, int npix, int bpp, std::vector<std::uint8_t> &out) {
+    constexpr int max_chunk_length = 128;
+    int x = 0;
+    while (x<npix) {
+        // Pixel x equals pixel x+1 iff its bytes equal the bytes bpp further on,
+        // so the run length is the first mismatch between the row and itself shifted by one pixel.
+        int limit = std::min(npix-x, max_chunk_length);
+        const std::uint8_t *p = row+size_t(x)*bpp;
+        int run = 1 + static_cast<int>(first_mismatch(p, p+bpp, size_t(limit-1)*bpp)/bpp);
+        if (run>1) {
+            out.push_back(static_cast<std::uint8_t>(run+127));
+            out.insert(out.end(), p, p+bpp);
+            x += run;
+            continue;
+        }
+        // Raw packet: extend until the next pixel starts a run.
+        int start = x++;
+        while (x<npix && x-start<max_chunk_length) {
+            if (x+1<npix && std::equal(row+size_t(x)*bpp, row+size_t(x+1)*bpp, row+size_t(x+1)*bpp))
+                break;
+            x++;
+        }
+        out.push_back(static_cast<std::uint8_t>(x-start-1));
+        out.insert(out.end(), p, p+size_t(x-start)*bpp);
+    }
+}
+
+} // namespace
+
 TGAImage::TGAImage(const int w, const int h, const int bpp) : w(w), h(h), bpp(bpp), data(w*h*bpp, 0) {}
 
 bool TGAImage::read_tga_file(const std::string filename) {
@@ -98,73 +171,86 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
     return true;
 }
 
-bool TGAImage::write_tga_file(const std::string filename, const bool vflip, const bool rle) const {
+void TGAImage::encode_tga(std::vector<std::uint8_t> &out, const bool vflip, const bool rle) const {
     constexpr std::uint8_t developer_area_ref[4] = {0, 0, 0, 0};
     constexpr std::uint8_t extension_area_ref[4] = {0, 0, 0, 0};
     constexpr std::uint8_t footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
-    std::ofstream out;
-    out.open(filename, std::ios::binary);
-    if (!out.is_open()) {
-        std::cerr << "can't open file " << filename << "\n";
-        return false;
-    }
     TGAHeader header = {};
     header.bitsperpixel = bpp<<3;
     header.width  = w;
     header.height = h;
     header.datatypecode = (bpp==GRAYSCALE ? (rle?11:3) : (rle?10:2));
     header.imagedescriptor = vflip ? 0x00 : 0x20; // top-left or bottom-left origin
-    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
-    if (!out.good()) goto err;
-    if (!rle) {
-        out.write(reinterpret_cast<const char *>(data.data()), w*h*bpp);
-        if (!out.good()) goto err;
-    } else if (!unload_rle_data(out)) goto err;
-    out.write(reinterpret_cast<const char *>(developer_area_ref), sizeof(developer_area_ref));
-    if (!out.good()) goto err;
-    out.write(reinterpret_cast<const char *>(extension_area_ref), sizeof(extension_area_ref));
-    if (!out.good()) goto err;
-    out.write(reinterpret_cast<const char *>(footer), sizeof(footer));
-    if (!out.good()) goto err;
-    return true;
-err:
-    std::cerr << "can't dump the tga file\n";
-    return false;
-}
-
-bool TGAImage::unload_rle_data(std::ofstream &out) const {
-    const std::uint8_t max_chunk_length = 128;
-    size_t npixels = w*h;
-    size_t curpix = 0;
-    while (curpix<npixels) {
-        size_t chunkstart = curpix*bpp;
-        size_t curbyte = curpix*bpp;
-        std::uint8_t run_length = 1;
-        bool raw = true;
-        while (curpix+run_length<npixels && run_length<max_chunk_length) {
-            bool succ_eq = true;
-            for (int t=0; succ_eq && t<bpp; t++)
-                succ_eq = (data[curbyte+t]==data[curbyte+t+bpp]);
-            curbyte += bpp;
-            if (1==run_length)
-                raw = !succ_eq;
-            if (raw && succ_eq) {
-                run_length--;
-                break;
-            }
-            if (!raw && !succ_eq)
-                break;
-            run_length++;
-        }
-        curpix += run_length;
-        out.put(raw ? run_length-1 : run_length+127);
-        if (!out.good()) return false;
-        out.write(reinterpret_cast<const char *>(data.data()+chunkstart), (raw?run_length*bpp:bpp));
-        if (!out.good()) return false;
+    out.clear();
+    append(out, &header, sizeof(header));
+    if (!rle)
+        append(out, data.data(), data.size());
+    else
+        unload_rle_data(out);
+    append(out, developer_area_ref, sizeof(developer_area_ref));
+    append(out, extension_area_ref, sizeof(extension_area_ref));
+    append(out, footer, sizeof(footer));
+}
+
+bool TGAImage::write_tga_file(const std::string filename, const bool vflip, const bool rle) const {
+    std::ofstream out;
+    out.open(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    std::vector<std::uint8_t> file;
+    encode_tga(file, vflip, rle);
+    out.write(reinterpret_cast<const char *>(file.data()), file.size());
+    if (!out.good()) {
+        std::cerr << "can't dump the tga file\n";
+        return false;
     }
     return true;
 }
 
+void set_tga_parallel_for(int concurrency, TGAParallelFor fn) {
+    parallel_concurrency = concurrency;
+    parallel_for = std::move(fn);
+}
+
+// RLE packets never cross a scanline (as TGA 2.0 recommends), so rows are
+// independent: blocks of rows are encoded concurrently into their own buffers
+// and concatenated in order.
+void TGAImage::unload_rle_data(std::vector<std::uint8_t> &out) const {
+    constexpr int min_rows_per_block = 64;
+    const size_t row_bytes = size_t(w)*bpp;
+    int concurrency = parallel_concurrency ? parallel_concurrency : int(std::thread::hardware_concurrency());
+    int nblocks = std::clamp<int>(concurrency, 1, std::max(1, h/min_rows_per_block));
+    if (nblocks==1) {
+        out.reserve(out.size() + data.size() + data.size()/128 + h);
+        for (int y=0; y<h; y++)
+            encode_rle_row(data.data()+y*row_bytes, w, bpp, out);
+        return;
+    }
+    std::vector<std::vector<std::uint8_t>> blocks(nblocks);
+    auto encode_block = [&](int b) {
+        int y0 = h*b/nblocks, y1 = h*(b+1)/nblocks;
+        auto &dst = blocks[b];
+        dst.reserve((y1-y0)*(row_bytes + row_bytes/128 + 1));
+        for (int y=y0; y<y1; y++)
+            encode_rle_row(data.data()+y*row_bytes, w, bpp, dst);
+    };
+    if (parallel_for) {
+        parallel_for(nblocks, encode_block);
+    } else {
+        std::vector<std::thread> workers;
+        for (int b=0; b<nblocks; b++)
+            workers.emplace_back(encode_block, b);
+        for (auto &t : workers) t.join();
+    }
+    size_t total = out.size();
+    for (const auto &b : blocks) total += b.size();
+    out.reserve(total);
+    for (const auto &b : blocks)
+        out.insert(out.end(), b.begin(), b.end());
+}
+
 TGAColor TGAImage::get(const int x, const int y) const {
     if (!data.size() || x<0 || y<0 || x>=w || y>=h) return {};
     TGAColor ret = {0, 0, 0, 0, bpp};
@@ -179,17 +265,30 @@ void TGAImage::set(int x, int y, const TGAColor &c) {
 }
 
 void TGAImage::flip_horizontally() {
-    for (int i=0; i<w/2; i++)
-        for (int j=0; j<h; j++)
-            for (int b=0; b<bpp; b++)
-                std::swap(data[(i+j*w)*bpp+b], data[(w-1-i+j*w)*bpp+b]);
+    for (int j=0; j<h; j++) {
+        std::uint8_t *row = data.data()+size_t(j)*w*bpp;
+        if (bpp==RGBA) {
+            // Whole-pixel swaps; compilers turn this into shuffle instructions.
+            for (int i=0; i<w/2; i++) {
+                std::uint32_t a, b;
+                memcpy(&a, row+i*4, 4);
+                memcpy(&b, row+(w-1-i)*4, 4);
+                memcpy(row+i*4, &b, 4);
+                memcpy(row+(w-1-i)*4, &a, 4);
+            }
+        } else if (bpp==GRAYSCALE) {
+            std::reverse(row, row+w);
+        } else {
+            for (int i=0; i<w/2; i++)
+                std::swap_ranges(row+i*bpp, row+(i+1)*bpp, row+(w-1-i)*bpp);
+        }
+    }
 }
 
 void TGAImage::flip_vertically() {
-    for (int i=0; i<w; i++)
-        for (int j=0; j<h/2; j++)
-            for (int b=0; b<bpp; b++)
-                std::swap(data[(i+j*w)*bpp+b], data[(i+(h-1-j)*w)*bpp+b]);
+    const size_t row_bytes = size_t(w)*bpp;
+    for (int j=0; j<h/2; j++)
+        std::swap_ranges(data.begin()+j*row_bytes, data.begin()+(j+1)*row_bytes, data.begin()+(h-1-j)*row_bytes);
 }
 
 int TGAImage::width() const {
@@ -206,6 +305,11 @@ const std::uint8_t *TGAImage::framebuffer_ptr() const
     return data.data();
 }
 
+std::uint8_t *TGAImage::framebuffer_ptr()
+{
+    return data.data();
+}
+
 const std::uint8_t TGAImage::get_bpp() const
 {
     return bpp;
@@ -215,3 +319,54 @@ void TGAImage::clear()
 {
     std::fill(data.begin(), data.end(), 0);
 }
+
+void TGAImage::fill_rect(int x0, int y0, int x1, int y1, const TGAColor &c)
+{
+    x0 = std::max(x0, 0); y0 = std::max(y0, 0);
+    x1 = std::min(x1, w); y1 = std::min(y1, h);
+    if (x0>=x1 || y0>=y1) return;
+    if (x0==0 && x1==w) { // whole rows are contiguous
+        fill_pixels(row(y0), size_t(y1-y0)*w, c, bpp);
+        return;
+    }
+    for (int y=y0; y<y1; y++)
+        fill_pixels(row(y)+size_t(x0)*bpp, x1-x0, c, bpp);
+}
+
+void TGAImage::clear(const TGAColor &c)
+{
+    fill_pixels(data.data(), size_t(w)*h, c, bpp);
+}
+
+void fill_pixels(std::uint8_t *dst, size_t count, const TGAColor &c, int bpp)
+{
+    if (bpp==TGAImage::GRAYSCALE) {
+        std::memset(dst, c.bgra[0], count);
+        return;
+    }
+    size_t i = 0;
+#ifdef TGA_USE_SSE2
+    if (bpp==TGAImage::RGBA) {
+        std::uint32_t v;
+        std::memcpy(&v, c.bgra, 4);
+        const __m128i pattern = _mm_set1_epi32(static_cast<int>(v));
+        for (; i+4<=count; i+=4)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i*4), pattern);
+    } else if (bpp==TGAImage::RGB) {
+        // 16 pixels = 48 bytes = three 16-byte stores of a repeating pattern.
+        alignas(16) std::uint8_t bytes[48];
+        for (int k=0; k<48; k++) bytes[k] = c.bgra[k%3];
+        const __m128i p0 = _mm_load_si128(reinterpret_cast<const __m128i *>(bytes));
+        const __m128i p1 = _mm_load_si128(reinterpret_cast<const __m128i *>(bytes+16));
+        const __m128i p2 = _mm_load_si128(reinterpret_cast<const __m128i *>(bytes+32));
+        for (; i+16<=count; i+=16) {
+            std::uint8_t *p = dst+i*3;
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p), p0);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p+16), p1);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p+32), p2);
+        }
+    }
+#endif
+    for (; i<count; i++)
+        std::memcpy(dst+i*bpp, c.bgra, bpp);
+}
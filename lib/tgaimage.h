@@ -1,6 +1,9 @@
 #pragma once
 #include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <span>
 #include <vector>
 
 #pragma pack(push,1)
@@ -26,12 +29,37 @@ struct TGAColor {
     std::uint8_t& operator[](const int i) { return bgra[i]; }
 };
 
+// Runs task(0)..task(n-1), possibly concurrently, and returns when all are done.
+using TGAParallelFor = std::function<void(int n, const std::function<void(int)> &task)>;
+// Replaces the threads the RLE encoder splits rows across (by default one
+// std::thread per block, up to hardware_concurrency blocks), e.g. with an
+// application thread pool of `concurrency` threads. Call before encoding.
+void set_tga_parallel_for(int concurrency, TGAParallelFor fn);
+
+// Writes count copies of a bpp-byte pixel to dst (SIMD where available).
+void fill_pixels(std::uint8_t *dst, size_t count, const TGAColor &c, int bpp);
+
+// Unchecked view with the pixel size fixed at compile time, for hot loops
+// where TGAImage::set's bounds check and variable-size memcpy dominate.
+template <int BPP>
+struct TGAImageView {
+    static_assert(BPP==1 || BPP==3 || BPP==4, "TGA pixels are 1, 3 or 4 bytes");
+    std::uint8_t *data = nullptr;
+    int w = 0, h = 0;
+    std::uint8_t* row(const int y) const { return data+size_t(y)*w*BPP; }
+    std::uint8_t* pixel(const int x, const int y) const { return row(y)+size_t(x)*BPP; }
+    void set(const int x, const int y, const TGAColor &c) const { std::memcpy(pixel(x, y), c.bgra, BPP); }
+    void fill(const int x, const int y, const int n, const TGAColor &c) const { fill_pixels(pixel(x, y), n, c, BPP); }
+};
+
 struct TGAImage {
     enum Format { GRAYSCALE=1, RGB=3, RGBA=4 };
     TGAImage() = default;
     TGAImage(const int w, const int h, const int bpp);
     bool  read_tga_file(const std::string filename);
     bool write_tga_file(const std::string filename, const bool vflip=true, const bool rle=true) const;
+    // Encodes the whole file (header, pixels, footer) into out; write_tga_file issues it as one write.
+    void encode_tga(std::vector<std::uint8_t> &out, const bool vflip=true, const bool rle=true) const;
     void flip_horizontally();
     void flip_vertically();
     TGAColor get(const int x, const int y) const;
@@ -39,11 +67,22 @@ struct TGAImage {
     int width()  const;
     int height() const;
     const std::uint8_t* framebuffer_ptr() const;
+    std::uint8_t* framebuffer_ptr();
     const std::uint8_t get_bpp() const;
     void clear();
+    // Unchecked row access; rows are width()*get_bpp() bytes, row 0 first.
+    std::uint8_t* row(const int y) { return data.data()+size_t(y)*w*bpp; }
+    const std::uint8_t* row(const int y) const { return data.data()+size_t(y)*w*bpp; }
+    std::span<std::uint8_t> row_span(const int y) { return {row(y), size_t(w)*bpp}; }
+    std::span<const std::uint8_t> row_span(const int y) const { return {row(y), size_t(w)*bpp}; }
+    // Typed view; BPP must match get_bpp().
+    template <int BPP> TGAImageView<BPP> view() { return {data.data(), w, h}; }
+    // Bulk fills. fill_rect covers [x0,x1) x [y0,y1), clipped to the image.
+    void fill_rect(int x0, int y0, int x1, int y1, const TGAColor &c);
+    void clear(const TGAColor &c);
 private:
     bool   load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out) const;
+    void unload_rle_data(std::vector<std::uint8_t> &out) const;
     int w = 0, h = 0;
     std::uint8_t bpp = 0;
     std::vector<std::uint8_t> data = {};
@@ -0,0 +1,281 @@
+/// @file bench_codec.cpp
+/// @brief Export codec benchmark: TGA (raw and RLE) vs QOI vs stored PNG.
+/*!
+    Loads the reference renders from `assets/` (or the images given on the
+    command line), optionally upscales them to export resolution, and reports
+    encode/decode throughput in MB/s of raw pixel data along with the
+    compression ratio. TGA decoding goes through `read_tga_file` and a
+    temporary file, so it is only checked for correctness, not timed.
+    `--json <path|->` writes the results as JSON; with `-` the table goes to
+    stderr so stdout holds only the JSON. It also checks that QOI data cut
+    short is rejected rather than decoded in part. The exit code is non-zero
+    if any check fails.
+
+    Usage: bench_codec [--json <path|->] [--scale <n>] [--min-time <ms>] [image.tga]...
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "tgaimage.h"
+#include "imagecodec.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct CodecResult
+    {
+        std::string image;
+        std::string codec;
+        int width = 0;
+        int height = 0;
+        size_t encoded_bytes = 0;
+        double encode_mb_s = 0;
+        double decode_mb_s = 0;
+        bool roundtrip = false;
+    };
+
+    /// @brief Repeats `body` until `min_time_ms` elapses and returns the fastest run in ms.
+    double best_time_ms(double min_time_ms, const std::function<void()> &body)
+    {
+        using clock = std::chrono::steady_clock;
+        double best = 0, total = 0;
+        for (int runs = 0; total < min_time_ms || runs < 3; ++runs)
+        {
+            auto start = clock::now();
+            body();
+            double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            total += ms;
+            if (runs == 0 || ms < best)
+                best = ms;
+        }
+        return best;
+    }
+
+    TGAImage upscale(const TGAImage &src, int scale)
+    {
+        if (scale <= 1)
+            return src;
+        TGAImage dst(src.width() * scale, src.height() * scale, src.get_bpp());
+        for (int y = 0; y < dst.height(); ++y)
+            for (int x = 0; x < dst.width(); ++x)
+                dst.set(x, y, src.get(x / scale, y / scale));
+        return dst;
+    }
+
+    /// @brief Compares decoded pixels; decoders return top-down rows, so `a` is compared flipped.
+    bool same_pixels(const TGAImage &a, const TGAImage &b)
+    {
+        if (a.width() != b.width() || a.height() != b.height())
+            return false;
+        int bpp = std::min<int>(a.get_bpp(), b.get_bpp());
+        for (int y = 0; y < a.height(); ++y)
+            for (int x = 0; x < a.width(); ++x)
+            {
+                TGAColor p = a.get(x, a.height() - 1 - y), q = b.get(x, y);
+                for (int i = 0; i < bpp; ++i)
+                    if (p[i] != q[i])
+                        return false;
+            }
+        return true;
+    }
+
+    /// @brief Encodes a noisy image, so the stream is mostly RGB, RGBA and LUMA ops with
+    /// payloads, and checks that decoding fails for every shorter copy of the stream.
+    bool qoi_rejects_truncated()
+    {
+        TGAImage noise(16, 16, TGAImage::RGBA);
+        std::mt19937 rng(1);
+        TGAColor c;
+        c[3] = 255;
+        for (int y = 0; y < noise.height(); ++y)
+            for (int x = 0; x < noise.width(); ++x)
+            {
+                int kind = rng() % 3;
+                for (int i = 0; i < 3; ++i)
+                    c[i] = kind == 1 ? c[i] + rng() % 8 : rng();
+                if (kind == 2)
+                    c[3] = rng();
+                noise.set(x, y, c);
+            }
+        std::vector<std::uint8_t> full, cut;
+        encode_qoi(noise, full);
+
+        std::ostringstream errors; // one "truncated qoi data" per cut
+        std::streambuf *cerr_buffer = std::cerr.rdbuf(errors.rdbuf());
+        bool rejected = true;
+        for (size_t size = 0; size < full.size(); ++size)
+        {
+            cut.assign(full.begin(), full.begin() + size);
+            TGAImage decoded;
+            rejected = rejected && !decode_qoi(decoded, cut);
+        }
+        std::cerr.rdbuf(cerr_buffer);
+        return rejected;
+    }
+
+    std::vector<CodecResult> bench_image(const std::string &name, const TGAImage &img, double min_time_ms)
+    {
+        const double raw_mb = double(img.width()) * img.height() * img.get_bpp() / (1024.0 * 1024.0);
+        std::vector<CodecResult> results;
+        std::vector<std::uint8_t> encoded;
+
+        auto add = [&](const std::string &codec,
+                       const std::function<void()> &encode,
+                       const std::function<bool(TGAImage &)> &decode,
+                       bool time_decode)
+        {
+            CodecResult r;
+            r.image = name;
+            r.codec = codec;
+            r.width = img.width();
+            r.height = img.height();
+            r.encode_mb_s = raw_mb / (best_time_ms(min_time_ms, encode) / 1000.0);
+            r.encoded_bytes = encoded.size();
+            TGAImage decoded;
+            r.roundtrip = decode(decoded);
+            if (r.roundtrip && time_decode)
+                r.decode_mb_s = raw_mb / (best_time_ms(min_time_ms, [&]
+                                                       { decode(decoded); }) /
+                                          1000.0);
+            r.roundtrip = r.roundtrip && same_pixels(img, decoded);
+            results.push_back(r);
+        };
+
+        const std::string tmp_tga = (fs::temp_directory_path() / "bench_codec.tga").string();
+        auto decode_tga = [&](TGAImage &out)
+        {
+            std::ofstream f(tmp_tga, std::ios::binary);
+            f.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+            f.close();
+            return out.read_tga_file(tmp_tga);
+        };
+        add("tga_raw", [&]
+            { img.encode_tga(encoded, true, false); }, decode_tga, false);
+        add("tga_rle", [&]
+            { img.encode_tga(encoded, true, true); }, decode_tga, false);
+        add("qoi", [&]
+            { encode_qoi(img, encoded); }, [&](TGAImage &out)
+            { return decode_qoi(out, encoded); }, true);
+        add("png_stored", [&]
+            { encode_png(img, encoded); }, [&](TGAImage &out)
+            { return decode_png(out, encoded); }, true);
+        fs::remove(tmp_tga);
+        return results;
+    }
+
+    void write_json(std::ostream &out, const std::vector<CodecResult> &results)
+    {
+        out << "{\n  \"suite\": \"image_codecs\",\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const auto &r = results[i];
+            char line[512];
+            std::snprintf(line, sizeof(line),
+                          "    {\"image\": \"%s\", \"codec\": \"%s\", \"width\": %d, \"height\": %d, \"bytes\": %zu, "
+                          "\"encode_mb_s\": %.2f, \"decode_mb_s\": %.2f, \"roundtrip\": %s}%s\n",
+                          r.image.c_str(), r.codec.c_str(), r.width, r.height, r.encoded_bytes,
+                          r.encode_mb_s, r.decode_mb_s, r.roundtrip ? "true" : "false",
+                          i + 1 < results.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n}\n";
+    }
+
+    fs::path find_assets()
+    {
+        for (fs::path p = fs::current_path(); !p.empty(); p = p.parent_path())
+        {
+            if (fs::exists(p / "assets" / "persp_camera.tga"))
+                return p / "assets";
+            if (p == p.parent_path())
+                break;
+        }
+        return {};
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string json_path;
+    double min_time_ms = 200;
+    int scale = 2;
+    std::vector<std::string> images;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc)
+            json_path = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            min_time_ms = std::atof(argv[++i]);
+        else if (arg == "--scale" && i + 1 < argc)
+            scale = std::max(1, std::atoi(argv[++i]));
+        else if (!arg.empty() && arg[0] != '-')
+            images.push_back(arg);
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--json <path|->] [--scale <n>] [--min-time <ms>] [image.tga]...\n";
+            return 1;
+        }
+    }
+    if (images.empty())
+    {
+        fs::path assets = find_assets();
+        if (assets.empty())
+        {
+            std::cerr << "can't find the assets directory, pass images explicitly\n";
+            return 1;
+        }
+        for (const char *name : {"persp_camera.tga", "fixed_zbuffer.tga", "example.tga"})
+            images.push_back((assets / name).string());
+    }
+
+    std::FILE *table = json_path == "-" ? stderr : stdout;
+    std::vector<CodecResult> results;
+    bool ok = true;
+    std::fprintf(table, "%-20s %-11s %11s %8s %12s %12s %6s\n", "image", "codec", "size", "ratio", "enc MB/s", "dec MB/s", "ok");
+    for (const auto &path : images)
+    {
+        TGAImage src;
+        if (!src.read_tga_file(path))
+            return 1;
+        TGAImage img = upscale(src, scale);
+        std::string name = fs::path(path).filename().string();
+        double raw_bytes = double(img.width()) * img.height() * img.get_bpp();
+        for (const auto &r : bench_image(name, img, min_time_ms))
+        {
+            std::fprintf(table, "%-20s %-11s %5dx%-5d %8.2f %12.1f %12.1f %6s\n", r.image.c_str(), r.codec.c_str(),
+                         r.width, r.height, raw_bytes / r.encoded_bytes, r.encode_mb_s, r.decode_mb_s,
+                         r.roundtrip ? "yes" : "NO");
+            ok = ok && r.roundtrip;
+            results.push_back(r);
+        }
+    }
+
+    bool truncation_ok = qoi_rejects_truncated();
+    std::fprintf(table, "qoi rejects truncated data: %s\n", truncation_ok ? "yes" : "NO");
+    ok = ok && truncation_ok;
+
+    if (json_path == "-")
+        write_json(std::cout, results);
+    else if (!json_path.empty())
+    {
+        std::ofstream out(json_path);
+        if (!out.is_open())
+        {
+            std::cerr << "can't open file " << json_path << "\n";
+            return 1;
+        }
+        write_json(out, results);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+/// @file bench_layout.cpp
+/// @brief Linear vs tiled (8x8 Morton) color/depth layout benchmark.
+/*!
+    Renders the bundled models with both target layouts at several resolutions
+    and reports frame time (the tiled figure includes the resolve to a linear
+    image) plus hardware cache counters where the OS exposes them (Linux
+    perf_event_open; reported as n/a elsewhere or without permission). Every
+    tiled render is checked against the linear one.
+
+    Usage: bench_layout [--frames <n>] [--size <px>]... [model.obj]...
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "render.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    /// @brief Hardware cache-reference and cache-miss counters for the calling thread.
+    class CacheCounters
+    {
+    public:
+        CacheCounters()
+        {
+#if defined(__linux__)
+            refs = open_counter(PERF_COUNT_HW_CACHE_REFERENCES);
+            misses = open_counter(PERF_COUNT_HW_CACHE_MISSES);
+#endif
+        }
+        ~CacheCounters()
+        {
+#if defined(__linux__)
+            if (refs >= 0)
+                close(refs);
+            if (misses >= 0)
+                close(misses);
+#endif
+        }
+        bool available() const { return refs >= 0 && misses >= 0; }
+        void start()
+        {
+#if defined(__linux__)
+            for (int fd : {refs, misses})
+                if (fd >= 0)
+                {
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+#endif
+        }
+        /// @brief Stops counting and returns {references, misses}.
+        std::pair<long long, long long> stop()
+        {
+            long long r = 0, m = 0;
+#if defined(__linux__)
+            if (!available())
+                return {0, 0};
+            ioctl(refs, PERF_EVENT_IOC_DISABLE, 0);
+            ioctl(misses, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(refs, &r, sizeof(r)) != sizeof(r) || read(misses, &m, sizeof(m)) != sizeof(m))
+                return {0, 0};
+#endif
+            return {r, m};
+        }
+
+    private:
+        int refs = -1, misses = -1;
+#if defined(__linux__)
+        static int open_counter(unsigned long long config)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    };
+
+    struct LayoutResult
+    {
+        double ms = 0;
+        long long cache_refs = 0;
+        long long cache_misses = 0;
+    };
+
+    template <typename RenderFn>
+    LayoutResult measure(int frames, CacheCounters &counters, RenderFn &&render_frame)
+    {
+        render_frame(); // warm-up
+        std::vector<double> times;
+        LayoutResult res;
+        for (int i = 0; i < frames; ++i)
+        {
+            counters.start();
+            auto start = std::chrono::steady_clock::now();
+            render_frame();
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            auto [r, m] = counters.stop();
+            res.cache_refs += r;
+            res.cache_misses += m;
+        }
+        std::sort(times.begin(), times.end());
+        res.ms = times[times.size() / 2];
+        res.cache_refs /= frames;
+        res.cache_misses /= frames;
+        return res;
+    }
+
+    fs::path find_assets()
+    {
+        for (fs::path p = fs::current_path(); !p.empty(); p = p.parent_path())
+        {
+            if (fs::exists(p / "assets" / "diablo3_pose.obj"))
+                return p / "assets";
+            if (p == p.parent_path())
+                break;
+        }
+        return {};
+    }
+
+    std::string counter_str(const CacheCounters &counters, long long value)
+    {
+        if (!counters.available())
+            return "n/a";
+        return std::to_string(value);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 20;
+    std::vector<int> sizes;
+    std::vector<std::string> models;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+            frames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--size" && i + 1 < argc)
+            sizes.push_back(std::atoi(argv[++i]));
+        else if (!arg.empty() && arg[0] != '-')
+            models.push_back(arg);
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--frames <n>] [--size <px>]... [model.obj]...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (sizes.empty())
+        sizes = {512, 1024, 2048};
+    if (models.empty())
+    {
+        fs::path assets = find_assets();
+        if (assets.empty())
+        {
+            std::fprintf(stderr, "can't find the assets directory, pass models explicitly\n");
+            return 1;
+        }
+        for (const char *name : {"diablo3_pose.obj", "spere_zero.obj", "spere_non_zero.obj"})
+            models.push_back((assets / name).string());
+    }
+
+    CacheCounters counters;
+    bool ok = true;
+    std::printf("%-20s %6s %-7s %10s %14s %14s %6s\n", "model", "size", "layout", "ms/frame", "cache refs", "cache misses", "match");
+    for (const auto &path : models)
+    {
+        Model3D model(path);
+        std::string name = fs::path(path).filename().string();
+        for (int size : sizes)
+        {
+            Camera camera(vec3f(0.5f, 0.3f, 1.0f), vec3f(0, 0, 0), vec3f(0, 1, 0), size, size);
+            Renderer renderer(size, size);
+
+            TGAImage linear(size, size, TGAImage::RGB);
+            Zbuffer linear_depth(size, size);
+            LayoutResult lin = measure(frames, counters, [&]
+                                       {
+                linear.clear();
+                linear_depth.clear();
+                renderer.render_model(model, camera, linear_depth, linear); });
+
+            TiledImage tiled(size, size, TGAImage::RGB);
+            Zbuffer tiled_depth(size, size, TargetLayout::Tiled);
+            TGAImage resolved(size, size, TGAImage::RGB);
+            LayoutResult til = measure(frames, counters, [&]
+                                       {
+                tiled.clear();
+                tiled_depth.clear();
+                renderer.render_model(model, camera, tiled_depth, tiled.view());
+                tiled.resolve(resolved); });
+
+            bool match = std::memcmp(linear.framebuffer_ptr(), resolved.framebuffer_ptr(),
+                                     static_cast<size_t>(size) * size * TGAImage::RGB) == 0;
+            ok = ok && match;
+            std::printf("%-20s %6d %-7s %10.3f %14s %14s %6s\n", name.c_str(), size, "linear", lin.ms,
+                        counter_str(counters, lin.cache_refs).c_str(), counter_str(counters, lin.cache_misses).c_str(), "");
+            std::printf("%-20s %6d %-7s %10.3f %14s %14s %6s\n", name.c_str(), size, "tiled", til.ms,
+                        counter_str(counters, til.cache_refs).c_str(), counter_str(counters, til.cache_misses).c_str(),
+                        match ? "yes" : "NO");
+        }
+    }
+    return ok ? 0 : 1;
+}
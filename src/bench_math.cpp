@@ -0,0 +1,255 @@
+/// @file bench_math.cpp
+/// @brief Microbenchmarks for math_core.h.
+/*!
+    Times the vector and matrix primitives used by the renderer over batches of
+    random inputs and reports ns/op and throughput. Results are printed as a table
+    and, with `--json <path>`, written as machine-readable JSON so runs can be
+    compared against a stored baseline. With `--json -` the JSON goes to stdout
+    and the table to stderr.
+
+    Usage: bench_math [--json <path|->] [--min-time <ms>] [--batch <n>]...
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "math_core.h"
+
+namespace
+{
+    /// @brief Keeps the optimizer from discarding a computed value.
+    template <typename T>
+    inline void do_not_optimize(const T &value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "g"(&value) : "memory");
+#else
+        static volatile const void *sink;
+        sink = &value;
+#endif
+    }
+
+    struct BenchResult
+    {
+        std::string name;
+        size_t batch = 0;
+        size_t ops = 0;
+        double ns_per_op = 0;
+        double mops_per_sec = 0;
+    };
+
+    /// @brief Runs `body` (one pass over a batch of `batch` ops) until `min_time_ms` elapses.
+    /*!
+        The pass is repeated in rounds; the fastest round is reported so that
+        scheduling noise on shared build machines does not skew the numbers.
+     */
+    BenchResult run(const std::string &name, size_t batch, double min_time_ms, const std::function<void()> &body)
+    {
+        using clock = std::chrono::steady_clock;
+        body(); // warm-up
+
+        size_t passes = 1;
+        for (;;)
+        {
+            auto start = clock::now();
+            for (size_t i = 0; i < passes; ++i)
+                body();
+            double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            if (ms >= min_time_ms / 10 || passes >= (size_t(1) << 30))
+                break;
+            passes *= 2;
+        }
+
+        double best_ns = 0;
+        double total_ms = 0;
+        size_t rounds = 0;
+        while (total_ms < min_time_ms || rounds < 3)
+        {
+            auto start = clock::now();
+            for (size_t i = 0; i < passes; ++i)
+                body();
+            double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            total_ms += ns / 1e6;
+            double per_op = ns / static_cast<double>(passes * batch);
+            if (rounds == 0 || per_op < best_ns)
+                best_ns = per_op;
+            ++rounds;
+        }
+
+        BenchResult res;
+        res.name = name;
+        res.batch = batch;
+        res.ops = passes * batch * rounds;
+        res.ns_per_op = best_ns;
+        res.mops_per_sec = best_ns > 0 ? 1e3 / best_ns : 0;
+        return res;
+    }
+
+    mat4 random_mat4(std::mt19937 &rng)
+    {
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+        mat4 m;
+        for (size_t i = 0; i < 4; ++i)
+            for (size_t j = 0; j < 4; ++j)
+                m[i][j] = dist(rng) + (i == j ? 4.f : 0.f); // diagonally dominant, always invertible
+        return m;
+    }
+
+    vec3f random_vec3(std::mt19937 &rng)
+    {
+        std::uniform_real_distribution<float> dist(0.1f, 1.f);
+        return vec3f(dist(rng), dist(rng), dist(rng));
+    }
+
+    vec4f random_vec4(std::mt19937 &rng)
+    {
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+        return vec4f(dist(rng), dist(rng), dist(rng), 1.f);
+    }
+
+    std::vector<BenchResult> bench_batch(size_t batch, double min_time_ms)
+    {
+        std::mt19937 rng(42);
+        std::vector<vec3f> a3(batch), b3(batch), out3(batch);
+        std::vector<vec4f> v4(batch), out4(batch);
+        std::vector<mat4> ma(batch), mb(batch), outm(batch);
+        std::vector<float> outf(batch);
+        for (size_t i = 0; i < batch; ++i)
+        {
+            a3[i] = random_vec3(rng);
+            b3[i] = random_vec3(rng);
+            v4[i] = random_vec4(rng);
+            ma[i] = random_mat4(rng);
+            mb[i] = random_mat4(rng);
+        }
+
+        std::vector<BenchResult> results;
+        results.push_back(run("vec3f_add", batch, min_time_ms, [&]
+                              {
+            for (size_t i = 0; i < batch; ++i)
+                out3[i] = a3[i] + b3[i];
+            do_not_optimize(out3); }));
+        results.push_back(run("vec3f_dot", batch, min_time_ms, [&]
+                              {
+            for (size_t i = 0; i < batch; ++i)
+                outf[i] = a3[i] * b3[i];
+            do_not_optimize(outf); }));
+        results.push_back(run("vec3f_cross", batch, min_time_ms, [&]
+                              {
+            for (size_t i = 0; i < batch; ++i)
+                out3[i] = a3[i] ^ b3[i];
+            do_not_optimize(out3); }));
+        results.push_back(run("vec3f_normalize", batch, min_time_ms, [&]
+                              {
+            for (size_t i = 0; i < batch; ++i)
+            {
+                out3[i] = a3[i];
+                out3[i].normalize();
+            }
+            do_not_optimize(out3); }));
+        results.push_back(run("mat4_mul_vec4", batch, min_time_ms, [&]
+                              {
+            for (size_t i = 0; i < batch; ++i)
+                out4[i] = ma[i] * v4[i];
+            do_not_optimize(out4); }));
+        results.push_back(run("mat4_mul_mat4", batch, min_time_ms, [&]
+                              {
+            for (size_t i = 0; i < batch; ++i)
+                outm[i] = ma[i] * mb[i];
+            do_not_optimize(outm); }));
+        results.push_back(run("mat4_det", batch, min_time_ms, [&]
+                              {
+            for (size_t i = 0; i < batch; ++i)
+                outf[i] = static_cast<float>(ma[i].det());
+            do_not_optimize(outf); }));
+        results.push_back(run("mat4_inverse", batch, min_time_ms, [&]
+                              {
+            for (size_t i = 0; i < batch; ++i)
+                outm[i] = ma[i].inverse().value_or(mat4{});
+            do_not_optimize(outm); }));
+        return results;
+    }
+
+    void write_json(std::ostream &out, const std::vector<BenchResult> &results)
+    {
+        out << "{\n  \"suite\": \"math_core\",\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const auto &r = results[i];
+            char line[256];
+            std::snprintf(line, sizeof(line),
+                          "    {\"name\": \"%s\", \"batch\": %zu, \"ops\": %zu, \"ns_per_op\": %.4f, \"mops_per_sec\": %.4f}%s\n",
+                          r.name.c_str(), r.batch, r.ops, r.ns_per_op, r.mops_per_sec,
+                          i + 1 < results.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n}\n";
+    }
+
+    /// Appends a batch size; false unless `text` is a whole number above 0.
+    bool parse_batch(const char *text, std::vector<size_t> &batches)
+    {
+        char *end = nullptr;
+        unsigned long long batch = std::strtoull(text, &end, 10);
+        if (end == text || *end != '\0' || batch == 0 || text[0] == '-')
+            return false;
+        batches.push_back(static_cast<size_t>(batch));
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string json_path;
+    double min_time_ms = 200;
+    std::vector<size_t> batches;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc)
+            json_path = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            min_time_ms = std::atof(argv[++i]);
+        else if (arg == "--batch" && i + 1 < argc && parse_batch(argv[i + 1], batches))
+            ++i;
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--json <path|->] [--min-time <ms>] [--batch <n>]...\n";
+            return 1;
+        }
+    }
+    if (batches.empty())
+        batches = {16, 1024, 65536};
+
+    std::FILE *table = json_path == "-" ? stderr : stdout;
+    std::vector<BenchResult> results;
+    std::fprintf(table, "%-18s %8s %12s %12s\n", "benchmark", "batch", "ns/op", "Mops/s");
+    for (size_t batch : batches)
+    {
+        for (const auto &r : bench_batch(batch, min_time_ms))
+        {
+            std::fprintf(table, "%-18s %8zu %12.3f %12.2f\n", r.name.c_str(), r.batch, r.ns_per_op, r.mops_per_sec);
+            results.push_back(r);
+        }
+    }
+
+    if (json_path == "-")
+        write_json(std::cout, results);
+    else if (!json_path.empty())
+    {
+        std::ofstream out(json_path);
+        if (!out.is_open())
+        {
+            std::cerr << "can't open file " << json_path << "\n";
+            return 1;
+        }
+        write_json(out, results);
+    }
+    return 0;
+}
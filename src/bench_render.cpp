@@ -0,0 +1,440 @@
+/// @file bench_render.cpp
+/// @brief End-to-end render benchmark with golden-image verification.
+/*!
+    Renders the bundled models from a fixed set of camera poses at several
+    resolutions and reports the median and p99 frame time, triangles per second
+    (faces submitted) and pixels per second (target size). Every render is
+    compared with its reference in `assets/golden/`: a pixel is bad if any
+    channel differs by more than `--tolerance`, and a render fails if more than
+    `--max-bad` of its pixels are bad. `--update-golden` rewrites the references
+    instead; smooth-shaded variants have references of their own. The exit code is
+    non-zero if any render fails or has no reference.
+    `--jobs` sizes the job system used by the parallel variants (0 = one thread per core).
+    The overdraw column is shaded fragments per covered pixel, counted on the
+    warm-up frame (see OverdrawStats). With `--json -` stdout holds only the
+    JSON; the table and the model loader's messages go to stderr.
+
+    Usage: bench_render [--frames <n>] [--size <px>]... [--tolerance <n>]
+                        [--max-bad <fraction>] [--update-golden] [--json <path|->]
+                        [--jobs <n>] [model.obj]...
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "render.h"
+#include "imagecodec.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Pose
+    {
+        float phi, theta, radius;
+    };
+
+    /// Front, high three-quarter and low close-up views (spherical coordinates, as in the viewport).
+    constexpr Pose poses[] = {{1.5f, 1.5f, 1.0f}, {0.6f, 1.1f, 1.3f}, {2.6f, 1.9f, 0.8f}};
+
+    Camera make_camera(const Pose &p, int width, int height)
+    {
+        vec3f eye = {p.radius * std::cos(p.phi) * std::sin(p.theta),
+                     p.radius * std::cos(p.theta),
+                     p.radius * std::sin(p.phi) * std::sin(p.theta)};
+        return Camera(eye, vec3f(0, 0, 0), vec3f(0, 1, 0), width, height);
+    }
+
+    /// @brief One way of producing a frame. All variants must match the same references.
+    struct Variant
+    {
+        const char *name;
+        std::function<void(Renderer &, const Model3D &, Camera &, Zbuffer &, TGAImage &)> render;
+        /// Lower bound on the allowed bad fraction, for variants that break depth ties differently
+        /// from the serial rasterizer (e.g. RasterStrategy::Atomic).
+        double min_max_bad = 0;
+        /// Suffix of the references this variant is checked against; empty for the flat-shaded ones.
+        const char *golden = "";
+        /// Largest target size the variant renders, 0 for all; smooth shading compresses poorly,
+        /// so its references are kept small.
+        int max_size = 0;
+    };
+
+    std::vector<Variant> variants()
+    {
+        return {
+            {"serial", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.render_model(model, camera, depth, image);
+             }},
+            {"tiles", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.jobs = &JobSystem::global();
+                 renderer.strategy = RasterStrategy::Tiles;
+                 renderer.render_model(model, camera, depth, image);
+             }},
+            {"sortlast", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.jobs = &JobSystem::global();
+                 renderer.strategy = RasterStrategy::SortLast;
+                 renderer.render_model(model, camera, depth, image);
+             }},
+            {"atomic", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.jobs = &JobSystem::global();
+                 renderer.strategy = RasterStrategy::Atomic;
+                 renderer.render_model(model, camera, depth, image);
+             },
+             0.03},
+            {"vbuffer", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.visibility_buffer = true;
+                 renderer.render_model(model, camera, depth, image);
+             }},
+            {"vbuf-mt", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.jobs = &JobSystem::global();
+                 renderer.visibility_buffer = true;
+                 renderer.render_model(model, camera, depth, image);
+             }},
+            {"f2b", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.overdraw_mode = OverdrawMode::SortFrontToBack;
+                 renderer.render_model(model, camera, depth, image);
+             },
+             0.03},
+            {"prepass", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.overdraw_mode = OverdrawMode::DepthPrepass;
+                 renderer.render_model(model, camera, depth, image);
+             }},
+            // Timed frames cull against the warm-up frame's depth.
+            {"occlusion", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.occlusion_culling = true;
+                 renderer.render_model(model, camera, depth, image);
+             }},
+            // The camera holds still, so timed frames reproject the warm-up frame onto itself.
+            {"temporal", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.temporal_refresh = 8;
+                 renderer.render_model(model, camera, depth, image);
+             }},
+            {"gouraud", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.shading = ShadingMode::Gouraud;
+                 renderer.render_model(model, camera, depth, image);
+             },
+             0, "gouraud", 256},
+            {"phong", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.shading = ShadingMode::Phong;
+                 renderer.render_model(model, camera, depth, image);
+             },
+             0, "phong", 256},
+            {"phong-vb", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 renderer.jobs = &JobSystem::global();
+                 renderer.visibility_buffer = true;
+                 renderer.shading = ShadingMode::Phong;
+                 renderer.render_model(model, camera, depth, image);
+             },
+             0, "phong", 256},
+            {"lights", [](Renderer &renderer, const Model3D &model, Camera &camera, Zbuffer &depth, TGAImage &image)
+             {
+                 image.clear();
+                 depth.clear();
+                 // One light of each kind, colored so a mixed-up lane shows; three lights run in four lanes.
+                 Light key, fill, spot;
+                 key.direction = {-1, -1, -1};
+                 key.color = {1, 0.9f, 0.8f};
+                 key.intensity = 0.7f;
+                 fill.type = LightType::Point;
+                 fill.position = {1.5f, 0.5f, 1};
+                 fill.color = {0.2f, 0.4f, 1};
+                 spot.type = LightType::Spot;
+                 spot.position = {0, 2, 0.5f};
+                 spot.direction = {0, -2, -0.5f};
+                 spot.color = {1, 0.3f, 0.2f};
+                 spot.intensity = 2;
+                 renderer.lights = {key, fill, spot};
+                 renderer.shading = ShadingMode::Phong;
+                 renderer.render_model(model, camera, depth, image);
+             },
+             0, "lights", 256},
+        };
+    }
+
+    struct Comparison
+    {
+        int max_delta = 0;
+        double bad_fraction = 0;
+    };
+
+    /// @brief Compare a render (row 0 = bottom) with a decoded reference (row 0 = top).
+    Comparison compare(const TGAImage &image, const TGAImage &golden, int tolerance)
+    {
+        Comparison c;
+        if (golden.width() != image.width() || golden.height() != image.height())
+        {
+            c.max_delta = 255;
+            c.bad_fraction = 1;
+            return c;
+        }
+        const int w = image.width(), h = image.height();
+        long long bad = 0;
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+            {
+                TGAColor a = image.get(x, y), b = golden.get(x, h - 1 - y);
+                int delta = 0;
+                for (int i = 0; i < 3; ++i)
+                    delta = std::max(delta, std::abs(a.bgra[i] - b.bgra[i]));
+                c.max_delta = std::max(c.max_delta, delta);
+                bad += delta > tolerance;
+            }
+        c.bad_fraction = static_cast<double>(bad) / (static_cast<double>(w) * h);
+        return c;
+    }
+
+    struct RenderResult
+    {
+        std::string model;
+        std::string variant;
+        int size = 0;
+        int pose = 0;
+        size_t faces = 0;
+        double median_ms = 0;
+        double p99_ms = 0;
+        double overdraw = 0;
+        std::string golden; ///< "ok", "FAIL", "missing" or "updated"
+        Comparison diff;
+    };
+
+    void write_json(std::ostream &out, const std::vector<RenderResult> &results)
+    {
+        out << "{\n  \"suite\": \"render\",\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const auto &r = results[i];
+            double seconds = r.median_ms / 1e3;
+            char line[512];
+            std::snprintf(line, sizeof(line),
+                          "    {\"model\": \"%s\", \"variant\": \"%s\", \"size\": %d, \"pose\": %d, \"median_ms\": %.3f, "
+                          "\"p99_ms\": %.3f, \"tris_per_s\": %.0f, \"pixels_per_s\": %.0f, \"overdraw\": %.3f, \"golden\": \"%s\", "
+                          "\"max_delta\": %d, \"bad_fraction\": %.6f}%s\n",
+                          r.model.c_str(), r.variant.c_str(), r.size, r.pose, r.median_ms, r.p99_ms,
+                          r.faces / seconds, static_cast<double>(r.size) * r.size / seconds, r.overdraw, r.golden.c_str(),
+                          r.diff.max_delta, r.diff.bad_fraction, i + 1 < results.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n}\n";
+    }
+
+    fs::path find_assets()
+    {
+        for (fs::path p = fs::current_path(); !p.empty(); p = p.parent_path())
+        {
+            if (fs::exists(p / "assets" / "diablo3_pose.obj"))
+                return p / "assets";
+            if (p == p.parent_path())
+                break;
+        }
+        return {};
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 10;
+    int tolerance = 8;
+    double max_bad = 0.001;
+    bool update = false;
+    std::string json_path;
+    std::vector<int> sizes;
+    std::vector<std::string> models;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+            frames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--size" && i + 1 < argc)
+            sizes.push_back(std::atoi(argv[++i]));
+        else if (arg == "--tolerance" && i + 1 < argc)
+            tolerance = std::atoi(argv[++i]);
+        else if (arg == "--max-bad" && i + 1 < argc)
+            max_bad = std::atof(argv[++i]);
+        else if (arg == "--update-golden")
+            update = true;
+        else if (arg == "--json" && i + 1 < argc)
+            json_path = argv[++i];
+        else if (arg == "--jobs" && i + 1 < argc)
+            JobSystem::configure_global(std::max(0, std::atoi(argv[++i])), false);
+        else if (!arg.empty() && arg[0] != '-')
+            models.push_back(arg);
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--frames <n>] [--size <px>]... [--tolerance <n>] [--max-bad <fraction>]\n"
+                      << "       [--update-golden] [--json <path|->] [--jobs <n>] [model.obj]...\n";
+            return 1;
+        }
+    }
+    if (sizes.empty())
+        sizes = {256, 512, 1024};
+
+    fs::path assets = find_assets();
+    if (assets.empty())
+    {
+        std::cerr << "can't find the assets directory\n";
+        return 1;
+    }
+    fs::path golden_dir = assets / "golden";
+    if (models.empty())
+        for (const char *name : {"diablo3_pose.obj", "spere_zero.obj", "spere_non_zero.obj"})
+            models.push_back((assets / name).string());
+    if (update)
+        fs::create_directories(golden_dir);
+
+    const bool json_stdout = json_path == "-";
+    std::FILE *table = json_stdout ? stderr : stdout;
+    std::streambuf *stdout_buffer = std::cout.rdbuf();
+    if (json_stdout)
+        std::cout.rdbuf(std::cerr.rdbuf()); // Model3D reports progress on std::cout
+
+    const std::vector<Variant> all = variants();
+    std::vector<RenderResult> results;
+    bool ok = true;
+    std::fprintf(table, "job system: %zu thread(s)\n", JobSystem::global().threads());
+    std::fprintf(table, "%-20s %5s %4s %-8s %9s %9s %10s %10s %8s %-8s\n", "model", "size", "pose", "variant", "median ms", "p99 ms",
+                 "Mtris/s", "Mpx/s", "overdraw", "golden");
+    for (const auto &path : models)
+    {
+        Model3D model(path);
+        std::string stem = fs::path(path).stem().string();
+        for (int size : sizes)
+            for (int p = 0; p < static_cast<int>(std::size(poses)); ++p)
+            {
+                Camera camera = make_camera(poses[p], size, size);
+                struct Reference
+                {
+                    fs::path path;
+                    TGAImage image;
+                    bool loaded = false;
+                };
+                std::map<std::string, Reference> references; ///< By Variant::golden.
+
+                for (const Variant &variant : all)
+                {
+                    if (variant.max_size && size > variant.max_size)
+                        continue;
+                    auto [found, first_use] = references.try_emplace(variant.golden);
+                    Reference &golden = found->second;
+                    if (first_use)
+                    {
+                        std::string suffix = *variant.golden ? std::string("_") + variant.golden : "";
+                        golden.path = golden_dir / (stem + "_p" + std::to_string(p) + "_" + std::to_string(size) + suffix + ".qoi");
+                        golden.loaded = !update && fs::exists(golden.path) && read_image(golden.image, golden.path.string());
+                    }
+                    Renderer renderer(size, size);
+                    Zbuffer depth(size, size);
+                    TGAImage image(size, size, TGAImage::RGB);
+                    renderer.measure_overdraw = true;
+                    variant.render(renderer, model, camera, depth, image); // warm-up
+                    renderer.measure_overdraw = false;
+
+                    std::vector<double> times;
+                    for (int f = 0; f < frames; ++f)
+                    {
+                        auto start = std::chrono::steady_clock::now();
+                        variant.render(renderer, model, camera, depth, image);
+                        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                    }
+                    std::sort(times.begin(), times.end());
+
+                    RenderResult r;
+                    r.model = stem;
+                    r.variant = variant.name;
+                    r.size = size;
+                    r.pose = p;
+                    r.faces = model.render_obj.size();
+                    r.median_ms = times[times.size() / 2];
+                    r.p99_ms = times[static_cast<size_t>(std::ceil(0.99 * times.size())) - 1];
+                    r.overdraw = renderer.overdraw_stats.overdraw();
+                    if (update && first_use)
+                    {
+                        // The first variant of each reference writes it; the others are checked against what it wrote.
+                        r.golden = write_image(image, golden.path.string()) ? "updated" : "FAIL";
+                        golden.loaded = read_image(golden.image, golden.path.string());
+                    }
+                    else if (!golden.loaded)
+                        r.golden = "missing";
+                    else
+                    {
+                        r.diff = compare(image, golden.image, tolerance);
+                        r.golden = r.diff.bad_fraction <= std::max(max_bad, variant.min_max_bad) ? "ok" : "FAIL";
+                    }
+                    ok = ok && (r.golden == "ok" || r.golden == "updated");
+
+                    double seconds = r.median_ms / 1e3;
+                    std::fprintf(table, "%-20s %5d %4d %-8s %9.3f %9.3f %10.2f %10.2f %8.2f %-8s", stem.c_str(), size, p, variant.name,
+                                 r.median_ms, r.p99_ms, r.faces / seconds / 1e6, static_cast<double>(size) * size / seconds / 1e6,
+                                 r.overdraw, r.golden.c_str());
+                    if (r.golden == "FAIL" && golden.loaded)
+                        std::fprintf(table, " (max delta %d, %.3f%% bad)", r.diff.max_delta, r.diff.bad_fraction * 100);
+                    std::fprintf(table, "\n");
+                    results.push_back(r);
+                }
+            }
+    }
+
+    if (json_stdout)
+    {
+        std::cout.rdbuf(stdout_buffer);
+        write_json(std::cout, results);
+    }
+    else if (!json_path.empty())
+    {
+        std::ofstream out(json_path);
+        if (!out.is_open())
+        {
+            std::cerr << "can't open file " << json_path << "\n";
+            return 1;
+        }
+        write_json(out, results);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,470 @@
+/// @file cli.cpp
+/// @brief Headless batch renderer (`nanorender-cli`).
+/*!
+    Renders N frames of a model without SDL or a display and writes them through
+    the asynchronous export queue. The camera either orbits the model (turntable)
+    or follows a camera path file with one `phi theta radius` triple per line
+    (radians, same spherical coordinates as the viewport).
+
+    Usage:
+        nanorender-cli --model <file.obj> [--texture <image>] [--size <W>x<H>]
+                       [--frames <n>] [--camera <phi>,<theta>,<radius>]
+                       [--camera-path <file>] [--output <pattern>] [--no-output]
+                       [--queue-depth <n>] [--writers <n>] [--threads <n>]
+                       [--jobs <n>] [--pin] [--raster auto|tiles|sortlast|atomic]
+                       [--visibility-buffer] [--overdraw none|sort|prepass]
+                       [--overdraw-stats] [--occlusion] [--temporal <n>] [--shading flat|gouraud|phong]
+                       [--light <kind>,<x>,<y>,<z>[,<r>,<g>,<b>]]... [--trace <file.json>]
+
+    The output pattern takes one `%d` (optionally `%0Nd`) for the frame number;
+    the extension selects the format (.tga, .qoi, .png).
+
+    With `--threads` other than 1, views are rendered concurrently by a
+    RenderFarm (0 = one thread per core) whose renderers share the job system;
+    finished views still go through the export queue.
+
+    `--jobs` sizes the job system that loads the model, splits each frame's
+    transform and tile rasterization and encodes TGA exports (0 = one thread
+    per core, the default; 1 = everything serial). `--pin` pins its workers to
+    cores. `--raster` overrides how frames are split (see RasterStrategy).
+    `--visibility-buffer` rasterizes triangle IDs and shades each pixel once.
+    `--overdraw` sorts triangles front to back or adds a depth pre-pass (see
+    OverdrawMode). `--overdraw-stats` counts fragments and prints the overdraw;
+    the counting is part of the timed render, so leave it off when measuring
+    speed. It needs `--threads 1`.
+    `--occlusion` skips face clusters hidden behind the previous frame, which
+    pays off for camera paths with small steps. `--temporal` reprojects each
+    fully drawn frame into the next `n` and only redraws the tiles it can't
+    cover (approximate; see Renderer::temporal_refresh). Both work from the
+    previous view, so they need `--threads 1`. `--shading` picks per-face, per-vertex or
+    per-pixel lighting (see ShadingMode). Each `--light` adds a
+    light (up to 8; without any, the model is lit from the camera): `dir` with
+    the direction it travels, `point` with its position, or `spot` with its
+    position, aimed at the origin; the color defaults to white.
+
+    `--trace` writes a Chrome trace of the run (needs a NANORENDER_PROFILE build);
+    profiled builds also print per-stage times and pipeline counters.
+ */
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "render.h"
+#include "export_queue.h"
+#include "render_farm.h"
+
+namespace
+{
+    struct Orbit
+    {
+        float phi = 1.5f;
+        float theta = 1.5f;
+        float radius = 1.0f;
+    };
+
+    struct Options
+    {
+        std::string model;
+        std::string texture;
+        int width = 800;
+        int height = 800;
+        int frames = 1;
+        bool frames_set = false;
+        Orbit camera;
+        std::string camera_path;
+        std::string output = "frame_%04d.tga";
+        bool write = true;
+        size_t queue_depth = 8;
+        size_t writers = 2;
+        size_t threads = 1;
+        size_t jobs = 0;
+        bool pin = false;
+        RasterStrategy raster = RasterStrategy::Auto;
+        bool visibility_buffer = false;
+        OverdrawMode overdraw = OverdrawMode::None;
+        bool overdraw_stats = false;
+        bool occlusion = false;
+        int temporal = 0;
+        ShadingMode shading = ShadingMode::Flat;
+        std::vector<Light> lights;
+        std::string trace;
+    };
+
+    void usage(const char *argv0)
+    {
+        std::cerr << "usage: " << argv0 << " --model <file.obj> [--texture <image>] [--size <W>x<H>]\n"
+                  << "       [--frames <n>] [--camera <phi>,<theta>,<radius>] [--camera-path <file>]\n"
+                  << "       [--output <pattern>] [--no-output] [--queue-depth <n>] [--writers <n>]\n"
+                  << "       [--threads <n>] [--jobs <n>] [--pin] [--raster auto|tiles|sortlast|atomic]\n"
+                  << "       [--visibility-buffer] [--overdraw none|sort|prepass] [--overdraw-stats] [--occlusion]\n"
+                  << "       [--temporal <n>] [--shading flat|gouraud|phong]\n"
+                  << "       [--light dir|point|spot,<x>,<y>,<z>[,<r>,<g>,<b>]]... [--trace <file.json>]\n";
+    }
+
+    /// @brief Expands the single `%d` / `%0Nd` in `pattern` with `frame`.
+    /*!
+        Parsed by hand rather than passed to printf, so user input is never used as a format string.
+        Without a placeholder, `_NNNN` is inserted before the extension when more than one frame is written.
+     */
+    std::string frame_name(const std::string &pattern, int frame, bool many)
+    {
+        size_t pct = pattern.find('%');
+        if (pct != std::string::npos)
+        {
+            size_t i = pct + 1;
+            bool zero = i < pattern.size() && pattern[i] == '0';
+            int width = 0;
+            while (i < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[i])))
+                width = width * 10 + (pattern[i++] - '0');
+            if (i < pattern.size() && pattern[i] == 'd')
+            {
+                std::string num = std::to_string(frame);
+                if (static_cast<int>(num.size()) < width)
+                    num.insert(0, width - num.size(), zero ? '0' : ' ');
+                return pattern.substr(0, pct) + num + pattern.substr(i + 1);
+            }
+        }
+        if (!many)
+            return pattern;
+        char num[16];
+        std::snprintf(num, sizeof(num), "_%04d", frame);
+        size_t dot = pattern.find_last_of('.');
+        if (dot == std::string::npos)
+            return pattern + num;
+        return pattern.substr(0, dot) + num + pattern.substr(dot);
+    }
+
+    bool load_camera_path(const std::string &filename, std::vector<Orbit> &path)
+    {
+        std::ifstream in(filename);
+        if (!in.is_open())
+        {
+            std::cerr << "can't open file " << filename << "\n";
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::stringstream ss(line);
+            Orbit o;
+            if (ss >> o.phi >> o.theta >> o.radius)
+                path.push_back(o);
+        }
+        if (path.empty())
+        {
+            std::cerr << "camera path " << filename << " has no poses\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool parse(int argc, char **argv, Options &opt)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--model" && has_value)
+                opt.model = argv[++i];
+            else if (arg == "--texture" && has_value)
+                opt.texture = argv[++i];
+            else if (arg == "--size" && has_value)
+            {
+                if (std::sscanf(argv[++i], "%dx%d", &opt.width, &opt.height) != 2 || opt.width <= 0 || opt.height <= 0)
+                    return false;
+            }
+            else if (arg == "--frames" && has_value)
+            {
+                opt.frames = std::max(1, std::atoi(argv[++i]));
+                opt.frames_set = true;
+            }
+            else if (arg == "--camera" && has_value)
+            {
+                if (std::sscanf(argv[++i], "%f,%f,%f", &opt.camera.phi, &opt.camera.theta, &opt.camera.radius) != 3)
+                    return false;
+            }
+            else if (arg == "--camera-path" && has_value)
+                opt.camera_path = argv[++i];
+            else if (arg == "--output" && has_value)
+                opt.output = argv[++i];
+            else if (arg == "--no-output")
+                opt.write = false;
+            else if (arg == "--queue-depth" && has_value)
+                opt.queue_depth = std::max(1, std::atoi(argv[++i]));
+            else if (arg == "--writers" && has_value)
+                opt.writers = std::max(1, std::atoi(argv[++i]));
+            else if (arg == "--threads" && has_value)
+                opt.threads = std::max(0, std::atoi(argv[++i]));
+            else if (arg == "--jobs" && has_value)
+                opt.jobs = std::max(0, std::atoi(argv[++i]));
+            else if (arg == "--pin")
+                opt.pin = true;
+            else if (arg == "--visibility-buffer")
+                opt.visibility_buffer = true;
+            else if (arg == "--raster" && has_value)
+            {
+                std::string mode = argv[++i];
+                if (mode == "auto")
+                    opt.raster = RasterStrategy::Auto;
+                else if (mode == "tiles")
+                    opt.raster = RasterStrategy::Tiles;
+                else if (mode == "sortlast")
+                    opt.raster = RasterStrategy::SortLast;
+                else if (mode == "atomic")
+                    opt.raster = RasterStrategy::Atomic;
+                else
+                    return false;
+            }
+            else if (arg == "--occlusion")
+                opt.occlusion = true;
+            else if (arg == "--temporal" && has_value)
+                opt.temporal = std::max(0, std::atoi(argv[++i]));
+            else if (arg == "--shading" && has_value)
+            {
+                std::string mode = argv[++i];
+                if (mode == "flat")
+                    opt.shading = ShadingMode::Flat;
+                else if (mode == "gouraud")
+                    opt.shading = ShadingMode::Gouraud;
+                else if (mode == "phong")
+                    opt.shading = ShadingMode::Phong;
+                else
+                    return false;
+            }
+            else if (arg == "--light" && has_value)
+            {
+                char kind[8];
+                Light light;
+                vec3f v;
+                int n = std::sscanf(argv[++i], "%7[a-z],%f,%f,%f,%f,%f,%f", kind, &v.x, &v.y, &v.z,
+                                    &light.color.x, &light.color.y, &light.color.z);
+                if ((n != 4 && n != 7) || opt.lights.size() == LightLanes::max_lights)
+                    return false;
+                std::string type = kind;
+                if (type == "dir")
+                    light.direction = v;
+                else if (type == "point" || type == "spot")
+                {
+                    light.type = type == "point" ? LightType::Point : LightType::Spot;
+                    light.position = v;
+                    light.direction = v * -1.f;
+                }
+                else
+                    return false;
+                if (light.type != LightType::Point && light.direction.norm() == 0)
+                    return false;
+                opt.lights.push_back(light);
+            }
+            else if (arg == "--overdraw" && has_value)
+            {
+                std::string mode = argv[++i];
+                if (mode == "none")
+                    opt.overdraw = OverdrawMode::None;
+                else if (mode == "sort")
+                    opt.overdraw = OverdrawMode::SortFrontToBack;
+                else if (mode == "prepass")
+                    opt.overdraw = OverdrawMode::DepthPrepass;
+                else
+                    return false;
+            }
+            else if (arg == "--overdraw-stats")
+                opt.overdraw_stats = true;
+            else if (arg == "--trace" && has_value)
+                opt.trace = argv[++i];
+            else
+                return false;
+        }
+        // Farm workers don't hand their per-frame statistics back.
+        if (opt.overdraw_stats && opt.threads != 1)
+        {
+            std::cerr << "--overdraw-stats needs --threads 1\n";
+            return false;
+        }
+        // The previous frame of a farm worker is some other view, so there is nothing to cull
+        // against or reproject.
+        if (opt.occlusion && opt.threads != 1)
+        {
+            std::cerr << "--occlusion needs --threads 1\n";
+            return false;
+        }
+        if (opt.temporal && opt.threads != 1)
+        {
+            std::cerr << "--temporal needs --threads 1\n";
+            return false;
+        }
+        return !opt.model.empty();
+    }
+
+    Camera make_camera(const Orbit &o, int width, int height)
+    {
+        const vec3f target = {0, 0, 0};
+        const vec3f up = {0, 1, 0};
+        vec3f eye = {
+            target.x + o.radius * std::cos(o.phi) * std::sin(o.theta),
+            target.y + o.radius * std::cos(o.theta),
+            target.z + o.radius * std::sin(o.phi) * std::sin(o.theta)};
+        return Camera(eye, target, up, width, height);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!opt.trace.empty())
+    {
+        if (!profiler::enabled)
+            std::cerr << "--trace ignored: built without NANORENDER_PROFILE\n";
+        profiler::start_trace();
+    }
+
+    std::vector<Orbit> poses;
+    if (!opt.camera_path.empty())
+    {
+        if (!load_camera_path(opt.camera_path, poses))
+            return 1;
+        if (!opt.frames_set)
+            opt.frames = static_cast<int>(poses.size());
+    }
+
+    JobSystem::configure_global(opt.jobs, opt.pin);
+    JobSystem &jobs = JobSystem::global();
+
+    auto load_start = std::chrono::steady_clock::now();
+    Model3D model(opt.model, jobs);
+    if (model.render_obj.empty())
+    {
+        std::cerr << "no faces loaded from " << opt.model << "\n";
+        return 1;
+    }
+    Texture texture;
+    if (!opt.texture.empty() && !texture.load(opt.texture))
+        return 1;
+    double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count();
+
+    std::vector<Camera> views;
+    views.reserve(opt.frames);
+    for (int i = 0; i < opt.frames; ++i)
+    {
+        Orbit pose = opt.camera;
+        if (!poses.empty())
+            pose = poses[i % poses.size()];
+        else
+            pose.phi += 2 * static_cast<float>(M_PI) * i / opt.frames; // turntable
+        views.push_back(make_camera(pose, opt.width, opt.height));
+    }
+
+    ExportQueue exporter(opt.width, opt.height, TGAImage::RGB, opt.queue_depth, opt.writers);
+    double render_ms = 0;
+    size_t threads = 1;
+    OverdrawStats overdraw;
+    OcclusionStats occlusion;
+    TemporalStats temporal;
+    size_t reused = 0;
+    auto start = std::chrono::steady_clock::now();
+    if (opt.threads == 1)
+    {
+        Renderer renderer(opt.width, opt.height);
+        renderer.texture = texture.empty() ? nullptr : &texture;
+        renderer.jobs = &jobs;
+        renderer.strategy = opt.raster;
+        renderer.visibility_buffer = opt.visibility_buffer;
+        renderer.overdraw_mode = opt.overdraw;
+        renderer.measure_overdraw = opt.overdraw_stats;
+        renderer.occlusion_culling = opt.occlusion;
+        renderer.temporal_refresh = opt.temporal;
+        renderer.shading = opt.shading;
+        renderer.lights = opt.lights;
+        Zbuffer zbuffer(opt.width, opt.height);
+        TGAImage scratch;
+        if (!opt.write)
+            scratch = TGAImage(opt.width, opt.height, TGAImage::RGB);
+
+        for (int i = 0; i < opt.frames; ++i)
+        {
+            TGAImage &frame = opt.write ? exporter.acquire() : scratch;
+            auto frame_start = std::chrono::steady_clock::now();
+            frame.clear();
+            zbuffer.clear();
+            renderer.render_model(model, views[i], zbuffer, frame);
+            render_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+            overdraw.depth_writes += renderer.overdraw_stats.depth_writes;
+            overdraw.shaded += renderer.overdraw_stats.shaded;
+            overdraw.covered += renderer.overdraw_stats.covered;
+            occlusion.clusters += renderer.occlusion_stats.clusters;
+            occlusion.culled += renderer.occlusion_stats.culled;
+            occlusion.late += renderer.occlusion_stats.late;
+            reused += renderer.temporal_stats.reused;
+            temporal.tiles += renderer.temporal_stats.tiles;
+            temporal.redrawn += renderer.temporal_stats.redrawn;
+            if (opt.write)
+                exporter.submit(frame, frame_name(opt.output, i, opt.frames > 1));
+        }
+    }
+    else
+    {
+        auto setup = [&](Renderer &renderer)
+        {
+            renderer.jobs = &jobs;
+            renderer.strategy = opt.raster;
+            renderer.visibility_buffer = opt.visibility_buffer;
+            renderer.overdraw_mode = opt.overdraw;
+            renderer.shading = opt.shading;
+            renderer.lights = opt.lights;
+        };
+        RenderFarm farm(model, opt.width, opt.height, TGAImage::RGB, opt.threads, texture.empty() ? nullptr : &texture, setup);
+        threads = farm.threads();
+        farm.render(views, [&](size_t view, const TGAImage &image)
+                    {
+            if (!opt.write)
+                return;
+            TGAImage &frame = exporter.acquire();
+            frame = image;
+            exporter.submit(frame, frame_name(opt.output, static_cast<int>(view), opt.frames > 1)); });
+        render_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    exporter.wait_idle();
+    double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("model      %s (%zu faces, loaded in %.1f ms)\n", opt.model.c_str(), model.render_obj.size(), load_ms);
+    std::printf("frames     %d at %dx%d on %zu render thread(s), %zu job thread(s)\n", opt.frames, opt.width, opt.height,
+                threads, jobs.threads());
+    std::printf("render     %.2f ms/frame, %.1f frames/sec\n", render_ms / opt.frames, opt.frames * 1000.0 / render_ms);
+    std::printf("end-to-end %.1f frames/sec (%.1f ms stalled on export)\n", opt.frames * 1000.0 / total_ms, exporter.stalled_ms());
+    if (opt.overdraw_stats)
+        std::printf("overdraw   %.3f shaded fragments per covered pixel (%.3f depth writes)\n", overdraw.overdraw(),
+                    overdraw.covered ? static_cast<double>(overdraw.depth_writes) / overdraw.covered : 0.0);
+    if (opt.threads == 1 && opt.occlusion)
+        std::printf("occlusion  %zu of %zu clusters culled, %zu drawn late\n", occlusion.culled, occlusion.clusters, occlusion.late);
+    if (opt.threads == 1 && opt.temporal)
+        std::printf("temporal   %zu of %d frames reprojected, %zu of %zu tiles redrawn\n", reused, opt.frames, temporal.redrawn, temporal.tiles);
+    if (opt.write)
+        std::printf("written    %zu, failed %zu\n", exporter.written(), exporter.failed());
+    if (profiler::enabled)
+    {
+        profiler::Snapshot stats = profiler::collect();
+        for (const auto &[name, ms] : stats.stage_ms)
+            std::printf("stage      %-14s %10.2f ms total\n", name, ms);
+        for (int i = 0; i < profiler::counter_count; ++i)
+            std::printf("counter    %-20s %llu\n", profiler::counter_name(static_cast<profiler::Counter>(i)),
+                        static_cast<unsigned long long>(stats.counters[i]));
+        std::printf("overdraw   %.2f\n", stats.overdraw());
+    }
+    if (!opt.trace.empty() && profiler::enabled && !profiler::stop_trace(opt.trace))
+        std::cerr << "can't write trace " << opt.trace << "\n";
+    return exporter.failed() ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+#include "export_queue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <iostream>
+#include "imagecodec.h"
+#include "profiler.h"
+
+ExportQueue::ExportQueue(int width, int height, int bpp, size_t depth, size_t nworkers)
+{
+    depth = std::max<size_t>(depth, 1);
+    nworkers = std::clamp<size_t>(nworkers, 1, depth);
+    frames.reserve(depth);
+    for (size_t i = 0; i < depth; ++i)
+    {
+        frames.emplace_back(width, height, bpp);
+        free_slots.push_back(depth - 1 - i);
+    }
+    for (size_t i = 0; i < nworkers; ++i)
+        workers.emplace_back(&ExportQueue::worker_loop, this);
+}
+
+ExportQueue::~ExportQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (auto &t : workers)
+        t.join();
+}
+
+TGAImage &ExportQueue::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (free_slots.empty())
+    {
+        auto start = std::chrono::steady_clock::now();
+        slot_freed.wait(lock, [this]
+                        { return !free_slots.empty(); });
+        stalled_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    size_t slot = free_slots.back();
+    free_slots.pop_back();
+    return frames[slot];
+}
+
+void ExportQueue::submit(TGAImage &frame, const std::string &filename, bool vflip)
+{
+    size_t slot = slot_of(frame);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({slot, filename, vflip});
+    }
+    job_ready.notify_one();
+}
+
+void ExportQueue::release(TGAImage &frame)
+{
+    free_slot(slot_of(frame));
+}
+
+void ExportQueue::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]
+              { return jobs.empty() && busy_jobs == 0; });
+}
+
+void ExportQueue::worker_loop()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_ready.wait(lock, [this]
+                           { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return; // stopping and drained
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            ++busy_jobs;
+        }
+
+        {
+            PROFILE_SCOPE("export");
+            if (write_image(frames[job.slot], job.filename, job.vflip))
+                ++written_count;
+            else
+                ++failed_count;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --busy_jobs;
+            free_slots.push_back(job.slot);
+            if (jobs.empty() && busy_jobs == 0)
+                idle.notify_all();
+        }
+        slot_freed.notify_one();
+    }
+}
+
+size_t ExportQueue::slot_of(const TGAImage &frame) const
+{
+    size_t slot = static_cast<size_t>(&frame - frames.data());
+    if (slot >= frames.size())
+        throw std::invalid_argument("frame does not belong to this ExportQueue");
+    return slot;
+}
+
+void ExportQueue::free_slot(size_t slot)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_slots.push_back(slot);
+    }
+    slot_freed.notify_one();
+}
@@ -0,0 +1,85 @@
+/// @file export_queue.h
+/// @brief Asynchronous frame export with a bounded pool of recycled frames.
+/*!
+    The renderer acquires a frame from the pool, renders into it and submits it
+    with a file name. Background threads encode and write submitted frames
+    (format picked by extension, see imagecodec.h) and return them to the pool.
+    When every frame is in flight, `acquire()` blocks until one is written:
+    this backpressure bounds memory while letting rendering run ahead of disk I/O
+    by up to `depth` frames.
+ */
+#ifndef EXPORT_QUEUE_H
+#define EXPORT_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tgaimage.h"
+
+class ExportQueue
+{
+public:
+    /// @param width Frame width.
+    /// @param height Frame height.
+    /// @param bpp Bytes per pixel of the frames (TGAImage::Format).
+    /// @param depth Number of frames in the pool, i.e. how far rendering may run ahead.
+    /// @param workers Number of encoder/writer threads.
+    ExportQueue(int width, int height, int bpp, size_t depth = 4, size_t workers = 2);
+    /// @brief Writes every submitted frame before returning.
+    ~ExportQueue();
+
+    ExportQueue(const ExportQueue &) = delete;
+    ExportQueue &operator=(const ExportQueue &) = delete;
+
+    /// @brief Take a free frame from the pool, blocking while all frames are in flight.
+    /*!
+        The frame keeps whatever the previous user left in it; clear it before rendering.
+     */
+    TGAImage &acquire();
+    /// @brief Queue an acquired frame for writing to `filename`.
+    void submit(TGAImage &frame, const std::string &filename, bool vflip = true);
+    /// @brief Return an acquired frame to the pool without writing it.
+    void release(TGAImage &frame);
+    /// @brief Block until every submitted frame has been written.
+    void wait_idle();
+
+    size_t depth() const { return frames.size(); }
+    size_t written() const { return written_count; }
+    size_t failed() const { return failed_count; }
+    /// @brief Total time acquire() spent blocked on backpressure, in milliseconds.
+    double stalled_ms() const { return stalled_ns / 1e6; }
+
+private:
+    struct Job
+    {
+        size_t slot;
+        std::string filename;
+        bool vflip;
+    };
+
+    void worker_loop();
+    size_t slot_of(const TGAImage &frame) const;
+    void free_slot(size_t slot);
+
+    std::vector<TGAImage> frames;
+    std::vector<size_t> free_slots;
+    std::deque<Job> jobs;
+    size_t busy_jobs = 0;
+    bool stopping = false;
+
+    std::mutex mutex;
+    std::condition_variable slot_freed;
+    std::condition_variable job_ready;
+    std::condition_variable idle;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> written_count{0};
+    std::atomic<size_t> failed_count{0};
+    std::atomic<long long> stalled_ns{0};
+};
+
+#endif // EXPORT_QUEUE_H
@@ -0,0 +1,211 @@
+/// @file framebuffer.h
+/// @brief Non-owning color target the renderer draws into.
+/*!
+    A `Framebuffer` is a view over externally owned pixel memory: a `TGAImage`,
+    a locked SDL streaming texture, or any other BGR(A) byte buffer. Rows are
+    addressed through a signed stride, so the renderer's bottom-left origin can
+    be mapped onto top-down memory without flipping the image afterwards.
+
+    A view can also address memory in a tiled layout: 8x8 pixel tiles stored
+    row by row, with the pixels inside a tile in Morton (Z) order. A triangle
+    then touches a few compact tiles instead of one cache line per scanline.
+    `TiledImage` owns such memory and resolves it to a linear target.
+ */
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "tgaimage.h"
+#include "profiler.h"
+
+/// @brief Memory layout of color and depth targets.
+enum class TargetLayout
+{
+    Linear, ///< Row-major scanlines.
+    Tiled   ///< 8x8 tiles, Morton order inside a tile.
+};
+
+constexpr int tile_size = 8;
+
+/// @brief Offset of (x, y) inside its tile: bits of x and y interleaved (x in the even bits).
+inline int morton_offset(int x, int y)
+{
+    static constexpr std::uint8_t spread[tile_size] = {0, 1, 4, 5, 16, 17, 20, 21};
+    return spread[x & (tile_size - 1)] | (spread[y & (tile_size - 1)] << 1);
+}
+
+/// @brief Number of tiles needed to cover `n` pixels.
+inline int tile_count(int n) { return (n + tile_size - 1) / tile_size; }
+
+/// @brief Element index of (x, y) in a tiled buffer that is `tiles_x` tiles wide.
+inline size_t tiled_index(int x, int y, int tiles_x)
+{
+    size_t tile = static_cast<size_t>(y / tile_size) * tiles_x + x / tile_size;
+    return tile * tile_size * tile_size + morton_offset(x, y);
+}
+
+class Framebuffer
+{
+public:
+    Framebuffer() = default;
+    /// @brief Wrap raw pixel memory.
+    /// @param pixels Pointer to the first byte of the topmost row in memory.
+    /// @param width Width in pixels.
+    /// @param height Height in pixels.
+    /// @param bpp Bytes per pixel (1, 3 or 4).
+    /// @param pitch Distance in bytes between two consecutive rows in memory.
+    /// @param flip_y If true, row 0 of the view is the last row in memory
+    ///               (bottom-left origin on top-down memory such as SDL textures).
+    Framebuffer(std::uint8_t *pixels, int width, int height, int bpp, std::ptrdiff_t pitch, bool flip_y = false)
+        : origin(flip_y ? pixels + (height - 1) * pitch : pixels),
+          stride(flip_y ? -pitch : pitch),
+          w(width), h(height), bytespp(bpp)
+    {
+    }
+
+    /// @brief View over tiled memory of `tile_count(width) * tile_count(height) * 64` pixels.
+    static Framebuffer tiled(std::uint8_t *pixels, int width, int height, int bpp)
+    {
+        Framebuffer fb;
+        fb.origin = pixels;
+        fb.w = width;
+        fb.h = height;
+        fb.bytespp = bpp;
+        fb.tiles_x = tile_count(width);
+        return fb;
+    }
+
+    /// @brief View over a TGAImage's own buffer, same row order as `TGAImage::set`.
+    static Framebuffer from_image(TGAImage &image)
+    {
+        return Framebuffer(image.framebuffer_ptr(), image.width(), image.height(), image.get_bpp(),
+                           static_cast<std::ptrdiff_t>(image.width()) * image.get_bpp());
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    int bpp() const { return bytespp; }
+    std::ptrdiff_t pitch() const { return stride; }
+    bool valid() const { return origin != nullptr; }
+    TargetLayout layout() const { return tiles_x ? TargetLayout::Tiled : TargetLayout::Linear; }
+
+    /// @brief Unchecked pointer to the first pixel of row `y`. Linear layout only.
+    std::uint8_t *row(int y) const { return origin + y * stride; }
+    /// @brief Unchecked pointer to pixel (x, y).
+    std::uint8_t *pixel(int x, int y) const
+    {
+        if (tiles_x)
+            return origin + tiled_index(x, y, tiles_x) * bytespp;
+        return row(y) + x * bytespp;
+    }
+
+    /// @brief Bounds-checked pixel write.
+    void set(int x, int y, const TGAColor &c) const
+    {
+        if (!origin || x < 0 || y < 0 || x >= w || y >= h)
+            return;
+        std::memcpy(pixel(x, y), c.bgra, bytespp);
+    }
+    /// @brief Bounds-checked pixel read.
+    TGAColor get(int x, int y) const
+    {
+        if (!origin || x < 0 || y < 0 || x >= w || y >= h)
+            return {};
+        TGAColor ret = {0, 0, 0, 0, static_cast<std::uint8_t>(bytespp)};
+        std::memcpy(ret.bgra, pixel(x, y), bytespp);
+        return ret;
+    }
+    /// @brief Unchecked write of `n` copies of `c` starting at (x, y) along the row. Linear layout only.
+    void fill_span(int x, int y, int n, const TGAColor &c) const
+    {
+        fill_pixels(pixel(x, y), n, c, bytespp);
+    }
+    /// @brief Set every pixel to zero. Padding bytes past `width * bpp` are left untouched.
+    void clear() const
+    {
+        PROFILE_SCOPE("clear_color");
+        if (tiles_x)
+        {
+            std::memset(origin, 0, static_cast<size_t>(tiles_x) * tile_count(h) * tile_size * tile_size * bytespp);
+            return;
+        }
+        for (int y = 0; y < h; ++y)
+            std::memset(row(y), 0, static_cast<size_t>(w) * bytespp);
+    }
+
+private:
+    std::uint8_t *origin = nullptr;
+    std::ptrdiff_t stride = 0;
+    int w = 0, h = 0;
+    int bytespp = 0;
+    int tiles_x = 0; ///< Non-zero for the tiled layout.
+};
+
+/// @brief Owning color target in the tiled layout.
+class TiledImage
+{
+public:
+    TiledImage() = default;
+    TiledImage(int width, int height, int bpp)
+        : w(width), h(height), bytespp(bpp),
+          data(static_cast<size_t>(tile_count(width)) * tile_count(height) * tile_size * tile_size * bpp, 0)
+    {
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    /// @brief Tiled view to render into.
+    Framebuffer view() { return Framebuffer::tiled(data.data(), w, h, bytespp); }
+    void clear() { std::fill(data.begin(), data.end(), 0); }
+
+    /// @brief Convert to a linear target (a TGAImage view or a locked SDL texture).
+    /*!
+        Walks the tiles in memory order and writes each tile's rows, so both the
+        reads and the writes stay within a few cache lines per tile.
+     */
+    void resolve(const Framebuffer &linear) const
+    {
+        if (linear.bpp() == bytespp && bytespp == TGAImage::RGB)
+            resolve_tiles<TGAImage::RGB>(linear);
+        else if (linear.bpp() == bytespp && bytespp == TGAImage::RGBA)
+            resolve_tiles<TGAImage::RGBA>(linear);
+        else
+            resolve_tiles<0>(linear);
+    }
+    void resolve(TGAImage &image) const { resolve(Framebuffer::from_image(image)); }
+
+private:
+    /// @brief Resolve with the pixel size fixed at compile time (BPP = 0: any size).
+    template <int BPP>
+    void resolve_tiles(const Framebuffer &linear) const
+    {
+        const int tiles_x = tile_count(w);
+        const int n = BPP ? BPP : std::min(bytespp, linear.bpp());
+        const int src_bpp = BPP ? BPP : bytespp;
+        const int dst_bpp = BPP ? BPP : linear.bpp();
+        const int rw = std::min(w, linear.width()), rh = std::min(h, linear.height());
+        for (int ty = 0; ty < tile_count(rh); ++ty)
+            for (int tx = 0; tx < tile_count(rw); ++tx)
+            {
+                const std::uint8_t *tile = data.data() + (static_cast<size_t>(ty) * tiles_x + tx) * tile_size * tile_size * src_bpp;
+                int y1 = std::min((ty + 1) * tile_size, rh);
+                int x1 = std::min((tx + 1) * tile_size, rw);
+                for (int y = ty * tile_size; y < y1; ++y)
+                {
+                    std::uint8_t *dst = linear.pixel(tx * tile_size, y);
+                    for (int x = tx * tile_size; x < x1; ++x, dst += dst_bpp)
+                        std::memcpy(dst, tile + morton_offset(x, y) * src_bpp, n);
+                }
+            }
+    }
+
+    int w = 0, h = 0;
+    int bytespp = 0;
+    std::vector<std::uint8_t> data;
+};
+
+#endif // FRAMEBUFFER_H
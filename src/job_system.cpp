@@ -0,0 +1,297 @@
+#include "job_system.h"
+
+#include <cstdlib>
+#include "tgaimage.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+namespace
+{
+    /// The pool the current thread works for, and its worker index.
+    struct CurrentWorker
+    {
+        const JobSystem *system = nullptr;
+        int index = -1;
+    };
+    thread_local CurrentWorker current;
+
+    bool pin_to_core(std::size_t core)
+    {
+        unsigned cores = std::thread::hardware_concurrency();
+        if (cores == 0)
+            return false;
+        core %= cores;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+        if (core >= sizeof(DWORD_PTR) * 8)
+            return false;
+        return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#else
+        return false;
+#endif
+    }
+
+    struct GlobalPool
+    {
+        std::mutex mutex;
+        std::unique_ptr<JobSystem> pool;
+        bool configured = false;
+        std::size_t threads = 0;
+        bool pin = false;
+    };
+
+    GlobalPool &global_pool()
+    {
+        static GlobalPool g;
+        return g;
+    }
+}
+
+JobSystem::JobSystem(std::size_t threads, bool pin)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    // Every worker must exist before any of them starts stealing.
+    for (std::size_t i = 1; i < threads; ++i)
+        workers.push_back(std::make_unique<Worker>());
+    for (std::size_t i = 0; i < workers.size(); ++i)
+        workers[i]->thread = std::thread(&JobSystem::worker_loop, this, i, pin);
+}
+
+JobSystem::~JobSystem()
+{
+    stopping = true;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_all();
+    for (auto &w : workers)
+        w->thread.join();
+}
+
+void JobSystem::run(TaskGroup &group, Task task)
+{
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+    Item item{&group, std::move(task)};
+    if (workers.empty())
+        execute(item);
+    else
+        push(std::move(item));
+}
+
+void JobSystem::then(TaskGroup &group, TaskGroup &next, Task task)
+{
+    next.pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(group.mutex);
+        if (group.pending.load(std::memory_order_acquire) != 0)
+        {
+            group.continuations.emplace_back(&next, std::move(task));
+            return;
+        }
+    }
+    Item item{&next, std::move(task)};
+    if (workers.empty())
+        execute(item);
+    else
+        push(std::move(item));
+}
+
+void JobSystem::wait(TaskGroup &group)
+{
+    while (std::size_t n = group.pending.load(std::memory_order_acquire))
+    {
+        Item item;
+        if (take(item))
+            execute(item);
+        else
+            group.pending.wait(n, std::memory_order_acquire);
+    }
+    // The last task may still be inside retire(); its lock tells us when it's out.
+    std::lock_guard<std::mutex> lock(group.mutex);
+    if (group.error)
+        std::rethrow_exception(std::exchange(group.error, nullptr));
+}
+
+void JobSystem::push(Item item)
+{
+    int self = worker_index();
+    if (self >= 0)
+    {
+        std::lock_guard<std::mutex> lock(workers[self]->mutex);
+        workers[self]->tasks.push_back(std::move(item));
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(injected_mutex);
+        injected.push_back(std::move(item));
+    }
+    queued.fetch_add(1);
+    if (sleeping.load() > 0)
+    {
+        // Taking the lock orders this push before a sleeper's predicate check.
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        wake.notify_one();
+    }
+}
+
+bool JobSystem::take(Item &item)
+{
+    int self = worker_index();
+    auto pop = [&](std::deque<Item> &tasks, bool back)
+    {
+        if (tasks.empty())
+            return false;
+        item = std::move(back ? tasks.back() : tasks.front());
+        back ? tasks.pop_back() : tasks.pop_front();
+        queued.fetch_sub(1);
+        return true;
+    };
+
+    if (self >= 0)
+    {
+        std::lock_guard<std::mutex> lock(workers[self]->mutex);
+        if (pop(workers[self]->tasks, true))
+            return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(injected_mutex);
+        if (pop(injected, false))
+            return true;
+    }
+    if (queued.load() == 0)
+        return false;
+    // Steal the oldest task of another worker, starting with our neighbour.
+    const std::size_t n = workers.size();
+    for (std::size_t i = 1; i <= n; ++i)
+    {
+        std::size_t victim = (static_cast<std::size_t>(self + 1) + i - 1) % n;
+        if (static_cast<int>(victim) == self)
+            continue;
+        std::lock_guard<std::mutex> lock(workers[victim]->mutex);
+        if (pop(workers[victim]->tasks, false))
+            return true;
+    }
+    return false;
+}
+
+void JobSystem::execute(Item &item)
+{
+    TaskGroup &group = *item.group;
+    try
+    {
+        item.task();
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(group.mutex);
+        if (!group.error)
+            group.error = std::current_exception();
+    }
+    item.task = nullptr; // release captures before the group can be seen as done
+    retire(group);
+}
+
+void JobSystem::retire(TaskGroup &group)
+{
+    decltype(group.continuations) continuations;
+    {
+        std::lock_guard<std::mutex> lock(group.mutex);
+        if (group.pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        continuations.swap(group.continuations);
+        group.pending.notify_all();
+    }
+    // `group` may be gone now; the continuations' groups are kept alive by their pending count.
+    for (auto &[next, task] : continuations)
+    {
+        Item item{next, std::move(task)};
+        if (workers.empty())
+            execute(item);
+        else
+            push(std::move(item));
+    }
+}
+
+void JobSystem::worker_loop(std::size_t index, bool pin)
+{
+    current = {this, static_cast<int>(index)};
+    // Core 0 is left to the thread that created the pool, which works on tasks in wait().
+    if (pin)
+        pin_to_core(index + 1);
+    for (;;)
+    {
+        Item item;
+        if (take(item))
+        {
+            execute(item);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping.fetch_add(1);
+        wake.wait(lock, [this]
+                  { return stopping.load() || queued.load() > 0; });
+        sleeping.fetch_sub(1);
+        if (stopping)
+            return;
+    }
+}
+
+int JobSystem::worker_index() const
+{
+    return current.system == this ? current.index : -1;
+}
+
+JobSystem &JobSystem::global()
+{
+    GlobalPool &g = global_pool();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    if (!g.pool)
+    {
+        if (!g.configured)
+        {
+            if (const char *jobs = std::getenv("NANORENDER_JOBS"))
+                g.threads = std::strtoul(jobs, nullptr, 10);
+            if (const char *pin = std::getenv("NANORENDER_PIN"))
+                g.pin = std::atoi(pin) != 0;
+        }
+        g.pool = std::make_unique<JobSystem>(g.threads, g.pin);
+        // TGA exports encode their row blocks on this pool instead of spawning threads.
+        JobSystem *pool = g.pool.get();
+        set_tga_parallel_for(static_cast<int>(pool->threads()), [pool](int n, const std::function<void(int)> &task)
+                             { pool->parallel_for(0, n, 1, [&task](std::size_t first, std::size_t last)
+                                                  {
+                                                      for (std::size_t i = first; i < last; ++i)
+                                                          task(static_cast<int>(i)); }); });
+    }
+    return *g.pool;
+}
+
+bool JobSystem::configure_global(std::size_t threads, bool pin)
+{
+    GlobalPool &g = global_pool();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    if (g.pool)
+        return false;
+    g.configured = true;
+    g.threads = threads;
+    g.pin = pin;
+    return true;
+}
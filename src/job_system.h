@@ -0,0 +1,151 @@
+/// @file job_system.h
+/// @brief Work-stealing thread pool with task groups, continuations and parallel_for.
+/*!
+    Every worker owns a deque. Tasks spawned on a worker go to the back of its
+    own deque and are popped from the back (newest first, while their data is
+    still in cache); idle workers steal from the front of other deques (oldest
+    first, usually the biggest pieces of work). Tasks submitted from threads
+    outside the pool go to a shared injection queue.
+
+    Tasks belong to a TaskGroup. `wait()` doesn't just block: the waiting
+    thread runs queued tasks until the group is done, so a pool of N threads
+    has N-1 workers and the caller makes up the last one, and nested waits
+    inside tasks can't starve the pool. The first exception thrown by a task
+    is rethrown by `wait()`.
+
+    `JobSystem::global()` is the process-wide pool used by model loading, the
+    renderer and TGA export. Its size and pinning are set with
+    `configure_global()` before first use, or with the `NANORENDER_JOBS` (thread
+    count) and `NANORENDER_PIN` (non-zero to pin) environment variables.
+ */
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// @brief Set of tasks that can be waited on and continued from as a whole.
+class TaskGroup
+{
+public:
+    TaskGroup() = default;
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    /// @brief True when no task of the group is queued or running.
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<std::size_t> pending{0};
+    std::mutex mutex; ///< Guards the fields below; also held while the last task retires.
+    std::vector<std::pair<TaskGroup *, std::function<void()>>> continuations;
+    std::exception_ptr error;
+};
+
+class JobSystem
+{
+public:
+    using Task = std::function<void()>;
+
+    /// @param threads Threads working on tasks, counting the thread that calls wait()
+    ///                (0 = one per core). With 1 there are no workers and tasks run inline.
+    /// @param pin Pin each worker to its own core (Linux and Windows; ignored elsewhere).
+    explicit JobSystem(std::size_t threads = 0, bool pin = false);
+    /// @brief Joins the workers. Tasks still queued are dropped; wait for groups first.
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    std::size_t threads() const { return workers.size() + 1; }
+
+    /// @brief Queue `task` as part of `group`.
+    void run(TaskGroup &group, Task task);
+    /// @brief Run `task` as part of `next` once every task of `group` has finished.
+    /*!
+        `next` counts the continuation as pending right away, so waiting on it
+        also waits for `group`. If `group` is already done the task is queued now.
+     */
+    void then(TaskGroup &group, TaskGroup &next, Task task);
+    /// @brief Run queued tasks until `group` is done, then rethrow its first exception, if any.
+    void wait(TaskGroup &group);
+
+    /// @brief Call `fn(first, last)` on disjoint subranges covering [begin, end) and wait for them.
+    /*!
+        Subranges hold at least `grain` indices (except the last) and there are
+        at most a few per thread, so `fn` should loop over its range.
+     */
+    template <typename Fn>
+    void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, Fn &&fn)
+    {
+        if (begin >= end)
+            return;
+        grain = std::max<std::size_t>(grain, 1);
+        std::size_t chunks = std::min((end - begin + grain - 1) / grain, threads() * 4);
+        if (chunks <= 1 || workers.empty())
+        {
+            fn(begin, end);
+            return;
+        }
+        TaskGroup group;
+        std::size_t n = end - begin;
+        for (std::size_t c = 0; c < chunks; ++c)
+        {
+            std::size_t first = begin + n * c / chunks, last = begin + n * (c + 1) / chunks;
+            run(group, [&fn, first, last]
+                { fn(first, last); });
+        }
+        wait(group);
+    }
+
+    /// @brief The process-wide pool, created on first use.
+    static JobSystem &global();
+    /// @brief Size the global pool. Only takes effect before its first use.
+    /// @return False if the global pool already exists.
+    static bool configure_global(std::size_t threads, bool pin);
+
+private:
+    struct Item
+    {
+        TaskGroup *group;
+        Task task;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Item> tasks;
+        std::thread thread;
+    };
+
+    void push(Item item);
+    bool take(Item &item);
+    void execute(Item &item);
+    void retire(TaskGroup &group);
+    void worker_loop(std::size_t index, bool pin);
+    int worker_index() const;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex injected_mutex;
+    std::deque<Item> injected;
+
+    std::atomic<std::size_t> queued{0}; ///< Tasks in all deques.
+    std::atomic<int> sleeping{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+};
+
+#endif // JOB_SYSTEM_H
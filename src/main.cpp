@@ -1,14 +1,18 @@
+#include <cstdio>
 #include <cstring>
 #include <random>
 #include <filesystem>
+#include "SDL3/SDL.h"
 #include "math_core.h"
 #include "model.h"
 #include "render.h"
+#include "export_queue.h"
+#include "render_thread.h"
 
 constexpr int width = 800;
 constexpr int height = 800;
+constexpr int bpp = TGAImage::RGB;
 
-TGAImage image(width, height, TGAImage::RGB);
 Zbuffer buffer(width, height);
 
 struct Button
@@ -35,6 +39,17 @@ std::string getAssetPath(const std::string &relative)
     return fullPath.string();
 }
 
+/// Loads `<model>_diffuse.tga` from next to the model; null if there is none.
+std::shared_ptr<const Texture> loadDiffuse(const std::string &modelPath)
+{
+    fs::path path = fs::path(modelPath);
+    path.replace_filename(path.stem().string() + "_diffuse.tga");
+    auto texture = std::make_shared<Texture>();
+    if (!fs::exists(path) || !texture->load(path.string()))
+        return nullptr;
+    return texture;
+}
+
 int main(int argc, char **argv)
 {
     SDL_Init(SDL_INIT_VIDEO);
@@ -42,10 +57,12 @@ int main(int argc, char **argv)
     SDL_Renderer *sdl_renderer = SDL_CreateRenderer(window, nullptr);
     SDL_Texture *texture = SDL_CreateTexture(
         sdl_renderer,
-        (image.get_bpp() == 3 ? SDL_PIXELFORMAT_RGB24 : SDL_PIXELFORMAT_RGBA32),
+        (bpp == TGAImage::RGB ? SDL_PIXELFORMAT_BGR24 : SDL_PIXELFORMAT_BGRA32),
         SDL_TEXTUREACCESS_STREAMING,
         width,
         height);
+    // Reduced-resolution frames are stretched over the window while dragging.
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_LINEAR);
 
     std::vector<Button> buttons = {
         {{10.0f, 10.0f, 150.0f, 40.0f}, "diablo3_pose.obj"},
@@ -53,12 +70,18 @@ int main(int argc, char **argv)
         {{10.0f, 110.0f, 150.0f, 40.0f}, "matilda.obj"},
         {{10.0f, 160.0f, 150.0f, 40.0f}, "RoninFinalS.obj"}};
 
-    Model3D model(getAssetPath(buttons[0].label), width, height);
+    // Shared with the render thread, which keeps the previous model alive until it's done with it.
+    std::shared_ptr<const Model3D> model = std::make_shared<Model3D>(getAssetPath(buttons[0].label));
+    std::shared_ptr<const Texture> diffuse = loadDiffuse(getAssetPath(buttons[0].label));
     SDL_Color buttonColorNormal = {100, 100, 200, 255};
     SDL_Color buttonColorHover = {200, 50, 50, 255};
 
     Camera camera;
     Renderer renderer(width, height);
+    renderer.texture = diffuse.get();
+    // Snapshots are encoded and written in the background so the viewport never waits on disk.
+    ExportQueue exporter(width, height, bpp, 2, 1);
+    int snapshot = 0;
 
     bool running = true;
     bool rotating = false;
@@ -72,9 +95,56 @@ int main(int argc, char **argv)
     const vec3f &target = {0, 0, 0};
     const vec3f &up = {0, 1, 0};
 
+    // Nothing is drawn unless something changed: `sceneDirty` requests a new frame
+    // from the render thread (camera, model, lost texture), `presentDirty` only recomposes
+    // the window from the existing texture and the buttons (hover, expose, resize).
+    // SDL leaves the back buffer undefined after a present, so a recompose always
+    // covers the whole window, but it is a texture blit plus a few rectangles.
+    bool sceneDirty = true;
+    bool presentDirty = true;
+    int hovered = -1;
+
+    // The viewport is rendered on its own thread (with dynamic resolution while the
+    // camera is dragged); finished frames wake the event loop with `frameReady`.
+    const Uint32 frameReady = SDL_RegisterEvents(1);
+    auto renderThread = std::make_unique<RenderThread>(width, height, bpp, [frameReady]
+                                                       {
+        SDL_Event ready = {};
+        ready.type = frameReady;
+        SDL_PushEvent(&ready); });
+    SDL_FRect shownRect = {0, 0, static_cast<float>(width), static_cast<float>(height)};
+
+    // Stats overlay (F1): last frame's render time and resolution, plus per-stage
+    // times and pipeline counters when built with NANORENDER_PROFILE. T records a trace.
+    bool showStats = false;
+    bool tracing = false;
+    // R: while dragging, reproject each full frame into the next few (see Renderer::temporal_refresh).
+    int temporalRefresh = 0;
+    RenderThread::Frame shownInfo;
+    double fps = 0;
+    Uint64 lastUpload = 0;
+    profiler::Snapshot lastTotals, frameStats;
+
+    auto buttonAt = [&](float x, float y)
+    {
+        for (size_t i = 0; i < buttons.size(); ++i)
+        {
+            const SDL_FRect &r = buttons[i].rect;
+            if (x >= r.x && x <= r.x + r.w && y >= r.y && y <= r.y + r.h)
+                return static_cast<int>(i);
+        }
+        return -1;
+    };
+
     while (running)
     {
-        uint32_t frameStart = SDL_GetTicks();
+        // Idle: sleep in the event queue instead of spinning at 60 fps. Refining a
+        // reduced-resolution frame doesn't need the loop to stay awake: the render
+        // thread does that on its own and every frame it finishes posts `frameReady`.
+        if (!sceneDirty && !presentDirty)
+            SDL_WaitEvent(nullptr);
+
+        bool interacting = false;
         SDL_Event e;
         while (SDL_PollEvent(&e))
         {
@@ -86,16 +156,15 @@ int main(int argc, char **argv)
             case SDL_EVENT_MOUSE_BUTTON_DOWN:
                 if (e.button.button == SDL_BUTTON_LEFT)
                 {
-                    int mx = e.button.x;
-                    int my = e.button.y;
-                    for (auto &btn : buttons)
+                    int clicked = buttonAt(e.button.x, e.button.y);
+                    if (clicked >= 0)
                     {
-                        if (mx >= btn.rect.x && mx <= btn.rect.x + btn.rect.w &&
-                            my >= btn.rect.y && my <= btn.rect.y + btn.rect.h)
-                        {
-                            std::cout << "Selected model: " << btn.label << "\n";
-                            model = Model3D(getAssetPath(btn.label), width, height);
-                        }
+                        const std::string &label = buttons[clicked].label;
+                        std::cout << "Selected model: " << label << "\n";
+                        model = std::make_shared<Model3D>(getAssetPath(label));
+                        diffuse = loadDiffuse(getAssetPath(label));
+                        renderer.texture = diffuse.get();
+                        sceneDirty = true;
                     }
                     rotating = true;
                     lastX = e.button.x;
@@ -107,6 +176,13 @@ int main(int argc, char **argv)
                     rotating = false;
                 break;
             case SDL_EVENT_MOUSE_MOTION:
+            {
+                int over = buttonAt(e.motion.x, e.motion.y);
+                if (over != hovered)
+                {
+                    hovered = over;
+                    presentDirty = true;
+                }
                 if (rotating)
                 {
                     int dx = e.motion.x - lastX;
@@ -121,60 +197,169 @@ int main(int argc, char **argv)
                         theta = M_PI - epsilon;
                     lastX = e.motion.x;
                     lastY = e.motion.y;
+                    interacting = interacting || dx || dy;
+                    sceneDirty = sceneDirty || interacting;
                 }
                 break;
+            }
             case SDL_EVENT_MOUSE_WHEEL:
                 radius -= e.wheel.y * 0.1f;
                 if (radius < 0.3f)
                     radius = 0.3f;
                 if (radius > 50.0f)
                     radius = 50.0f;
+                interacting = true;
+                sceneDirty = true;
+                break;
+            case SDL_EVENT_WINDOW_MOUSE_LEAVE:
+                if (hovered >= 0)
+                {
+                    hovered = -1;
+                    presentDirty = true;
+                }
+                break;
+            case SDL_EVENT_WINDOW_EXPOSED:
+            case SDL_EVENT_WINDOW_RESIZED:
+            case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+                presentDirty = true;
+                break;
+            case SDL_EVENT_RENDER_TARGETS_RESET:
+            case SDL_EVENT_RENDER_DEVICE_RESET:
+                // Texture contents may be gone.
+                sceneDirty = true;
+                break;
+            case SDL_EVENT_KEY_DOWN:
+                if (e.key.key == SDLK_S && !e.key.repeat)
+                {
+                    TGAImage &frame = exporter.acquire();
+                    frame.clear();
+                    buffer.clear();
+                    renderer.render_model(*model, camera, buffer, frame);
+                    std::string name = "nano_render_" + std::to_string(snapshot++) + ".tga";
+                    exporter.submit(frame, name);
+                    std::cout << "Saving " << name << "\n";
+                }
+                else if (e.key.key == SDLK_F1)
+                {
+                    showStats = !showStats;
+                    presentDirty = true;
+                }
+                else if (e.key.key == SDLK_T && !e.key.repeat && profiler::enabled)
+                {
+                    tracing = !tracing;
+                    if (tracing)
+                        profiler::start_trace();
+                    else if (profiler::stop_trace("nano_trace.json"))
+                        std::cout << "Saving nano_trace.json\n";
+                }
+                else if (e.key.key == SDLK_R && !e.key.repeat)
+                {
+                    temporalRefresh = temporalRefresh ? 0 : 8;
+                    std::cout << "Temporal reuse " << (temporalRefresh ? "on" : "off") << "\n";
+                }
                 break;
             }
         }
 
-        vec3f cameraPos = {
-            target.x + radius * std::cos(phi) * std::sin(theta),
-            target.y + radius * std::cos(theta),
-            target.z + radius * std::sin(phi) * std::sin(theta)};
-
-        camera = Camera(cameraPos, target, up);
+        if (sceneDirty)
+        {
+            vec3f cameraPos = {
+                target.x + radius * std::cos(phi) * std::sin(theta),
+                target.y + radius * std::cos(theta),
+                target.z + radius * std::sin(phi) * std::sin(theta)};
 
-        image.clear();
-        buffer.clear();
-        renderer.render_model(model, camera, buffer, image);
-        image.flip_vertically();
+            // `camera` is used for snapshots and the final export on this thread.
+            camera = Camera(cameraPos, target, up);
+            renderThread->request({model, diffuse, cameraPos, target, up, interacting, temporalRefresh});
+        }
 
-        SDL_UpdateTexture(texture, nullptr, image.framebuffer_ptr(), width * image.get_bpp());
-        SDL_RenderClear(sdl_renderer);
-        SDL_RenderTexture(sdl_renderer, texture, nullptr, nullptr);
+        // Upload the newest finished frame, if any; the render thread is already
+        // working on the next one in its other buffer.
+        bool uploaded = renderThread->consume([&](const RenderThread::Frame &frame)
+                                              {
+            PROFILE_SCOPE("upload");
+            SDL_Rect region = {0, 0, frame.width, frame.height};
+            SDL_UpdateTexture(texture, &region, frame.pixels.data(), frame.width * bpp);
+            shownRect = {0, 0, static_cast<float>(frame.width), static_cast<float>(frame.height)};
+            shownInfo.width = frame.width;
+            shownInfo.height = frame.height;
+            shownInfo.scale = frame.scale;
+            shownInfo.render_ms = frame.render_ms; });
+        if (uploaded)
+        {
+            Uint64 now = SDL_GetTicksNS();
+            if (lastUpload)
+                fps = 0.9 * fps + 0.1 * (1e9 / (now - lastUpload));
+            lastUpload = now;
+            profiler::Snapshot totals = profiler::collect();
+            frameStats = totals - lastTotals;
+            lastTotals = totals;
+        }
+        presentDirty = presentDirty || uploaded;
 
-        for (auto &btn : buttons)
+        if (presentDirty)
         {
-            float mx, my;
-            SDL_GetMouseState(&mx, &my);
-
-            bool hover = mx >= btn.rect.x && mx <= btn.rect.x + btn.rect.w &&
-                         my >= btn.rect.y && my <= btn.rect.y + btn.rect.h;
-
-            SDL_SetRenderDrawColor(sdl_renderer,
-                                   hover ? buttonColorHover.r : buttonColorNormal.r,
-                                   hover ? buttonColorHover.g : buttonColorNormal.g,
-                                   hover ? buttonColorHover.b : buttonColorNormal.b,
-                                   255);
-            SDL_RenderFillRect(sdl_renderer, &btn.rect);
+            PROFILE_SCOPE("present");
+            SDL_RenderClear(sdl_renderer);
+            SDL_RenderTexture(sdl_renderer, texture, &shownRect, nullptr);
+
+            for (size_t i = 0; i < buttons.size(); ++i)
+            {
+                const SDL_Color &color = static_cast<int>(i) == hovered ? buttonColorHover : buttonColorNormal;
+                SDL_SetRenderDrawColor(sdl_renderer, color.r, color.g, color.b, 255);
+                SDL_RenderFillRect(sdl_renderer, &buttons[i].rect);
+            }
+
+            if (showStats)
+            {
+                char lines[3][160];
+                int count = 1;
+                std::snprintf(lines[0], sizeof(lines[0]), "render %.1f ms  %dx%d (%.0f%%)  %.0f fps%s",
+                              shownInfo.render_ms, shownInfo.width, shownInfo.height, shownInfo.scale * 100.f, fps,
+                              tracing ? "  [tracing]" : "");
+                if (profiler::enabled)
+                {
+                    using profiler::Counter;
+                    std::snprintf(lines[1], sizeof(lines[1]), "transform %.2f  raster %.2f  clear %.2f  upload %.2f  present %.2f ms",
+                                  frameStats.stage("transform"), frameStats.stage("raster"),
+                                  frameStats.stage("clear_color") + frameStats.stage("clear_depth"),
+                                  frameStats.stage("upload"), frameStats.stage("present"));
+                    std::snprintf(lines[2], sizeof(lines[2]), "tris %llu  culled %llu  px tested %llu  written %llu  overdraw %.2f",
+                                  static_cast<unsigned long long>(frameStats[Counter::TrianglesSubmitted]),
+                                  static_cast<unsigned long long>(frameStats[Counter::TrianglesCulled]),
+                                  static_cast<unsigned long long>(frameStats[Counter::PixelsTested]),
+                                  static_cast<unsigned long long>(frameStats[Counter::PixelsWritten]),
+                                  frameStats.overdraw());
+                    count = 3;
+                }
+                SDL_FRect panel = {170.0f, 10.0f, 8.0f * 82, 12.0f * count + 8};
+                SDL_SetRenderDrawColor(sdl_renderer, 0, 0, 0, 255);
+                SDL_RenderFillRect(sdl_renderer, &panel);
+                SDL_SetRenderDrawColor(sdl_renderer, 255, 255, 255, 255);
+                for (int i = 0; i < count; ++i)
+                    SDL_RenderDebugText(sdl_renderer, panel.x + 4, panel.y + 4 + 12.0f * i, lines[i]);
+            }
+            SDL_RenderPresent(sdl_renderer);
         }
-        SDL_RenderPresent(sdl_renderer);
-        uint32_t frameTime = SDL_GetTicks() - frameStart;
-        if (frameTime < 16)
-            SDL_Delay(16 - frameTime);
+
+        sceneDirty = false;
+        presentDirty = false;
     }
 
+    renderThread.reset();
+    if (tracing && profiler::stop_trace("nano_trace.json"))
+        std::cout << "Saving nano_trace.json\n";
     SDL_DestroyRenderer(sdl_renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
-    image.flip_vertically();
-    image.write_tga_file("nano_render_result.tga");
+
+    // Export: the image is only needed here, so re-render the last view into it.
+    TGAImage &image = exporter.acquire();
+    image.clear();
+    buffer.clear();
+    renderer.render_model(*model, camera, buffer, image);
+    exporter.submit(image, "nano_render_result.tga");
+    exporter.wait_idle();
 
     std::cout << "Render finished!\n";
     system("pause");
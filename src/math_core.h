@@ -40,11 +40,11 @@ struct vec
         };
         struct
         {
-            T ivert, iuv, inorm, w;
+            T ivert, iuv, inorm;
         };
         struct
         {
-            T u, v, z, w;
+            T u, v;
         };
         T raw[N];
     };
@@ -556,33 +556,28 @@ struct Matrix
 
         for (size_t i = 0; i < rows; ++i)
         {
-            if (mat[i][i] == 0)
-            {
-                bool pivot = false;
-                for (size_t c = i + 1; c < rows; ++c)
-                {
-                    if (mat[c][i] != 0)
-                    {
-                        std::swap(mat[i], mat[c]);
-                        std::swap(inv[i], inv[c]);
-                        pivot = true;
-                        break;
-                    }
-                }
-                if (!pivot)
-                    return std::nullopt;
-            }
+            // Partial pivoting: use the largest remaining entry of the column.
+            size_t pivot = i;
+            for (size_t c = i + 1; c < rows; ++c)
+                if (std::abs(mat[c][i]) > std::abs(mat[pivot][i]))
+                    pivot = c;
+            if (mat[pivot][i] == 0)
+                return std::nullopt;
+            std::swap(mat[i], mat[pivot]);
+            std::swap(inv[i], inv[pivot]);
+
+            const T p = mat[i][i];
             for (size_t k = 0; k < rows; k++)
             {
-                mat[i][k] = mat[i][k] / mat[i][i];
-                inv[i][k] = inv[i][k] / mat[i][i];
+                mat[i][k] = mat[i][k] / p;
+                inv[i][k] = inv[i][k] / p;
             }
             for (size_t j = i + 1; j < rows; ++j)
             {
 
                 double coef = mat[j][i] / mat[i][i];
 
-                for (size_t k = i; k < rows; k++)
+                for (size_t k = 0; k < rows; k++)
                 {
                     mat[j][k] -= mat[i][k] * coef;
                     inv[j][k] -= inv[i][k] * coef;
@@ -0,0 +1,235 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace profiler
+{
+    namespace
+    {
+        struct ScopeEvent
+        {
+            const char *name;
+            std::uint64_t start_ns;
+            std::uint64_t duration_ns;
+        };
+
+        struct CounterEvent
+        {
+            const char *name;
+            std::uint64_t time_ns;
+            std::array<std::uint64_t, counter_count> values;
+        };
+
+        /// Per-thread records. Counters have a single writer (the owning thread), so they are
+        /// updated with plain relaxed loads and stores; `mutex` is only contended while collecting.
+        struct ThreadData
+        {
+            int tid = 0;
+            std::array<std::atomic<std::uint64_t>, counter_count> counters{};
+            std::array<std::uint64_t, counter_count> last_traced{};
+
+            std::mutex mutex;
+            std::vector<std::pair<const char *, std::uint64_t>> stage_ns;
+            std::vector<ScopeEvent> scopes;
+            std::vector<CounterEvent> counter_events;
+        };
+
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<ThreadData>> threads; // outlive their threads so totals survive
+            std::atomic<bool> tracing{false};
+        };
+
+        Registry &registry()
+        {
+            static Registry r;
+            return r;
+        }
+
+        ThreadData &local()
+        {
+            thread_local std::shared_ptr<ThreadData> data = []
+            {
+                auto d = std::make_shared<ThreadData>();
+                Registry &r = registry();
+                std::lock_guard<std::mutex> lock(r.mutex);
+                d->tid = static_cast<int>(r.threads.size()) + 1;
+                r.threads.push_back(d);
+                return d;
+            }();
+            return *data;
+        }
+
+        std::uint64_t now_ns()
+        {
+            static const auto epoch = std::chrono::steady_clock::now();
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+        }
+
+        void add_stage(std::vector<std::pair<const char *, double>> &stages, const char *name, double ms)
+        {
+            for (auto &[n, total] : stages)
+                if (std::strcmp(n, name) == 0)
+                {
+                    total += ms;
+                    return;
+                }
+            stages.emplace_back(name, ms);
+        }
+    }
+
+    const char *counter_name(Counter counter)
+    {
+        static constexpr const char *names[counter_count] = {
+            "triangles_submitted", "triangles_culled", "pixels_tested", "pixels_written", "pixels_covered"};
+        return names[static_cast<int>(counter)];
+    }
+
+    double Snapshot::stage(const char *name) const
+    {
+        for (const auto &[n, ms] : stage_ms)
+            if (std::strcmp(n, name) == 0)
+                return ms;
+        return 0;
+    }
+
+    double Snapshot::overdraw() const
+    {
+        std::uint64_t covered = (*this)[Counter::PixelsCovered];
+        return covered ? static_cast<double>((*this)[Counter::PixelsWritten]) / covered : 0;
+    }
+
+    Snapshot Snapshot::operator-(const Snapshot &earlier) const
+    {
+        Snapshot d;
+        for (int i = 0; i < counter_count; ++i)
+            d.counters[i] = counters[i] - earlier.counters[i];
+        for (const auto &[name, ms] : stage_ms)
+            d.stage_ms.emplace_back(name, ms - earlier.stage(name));
+        return d;
+    }
+
+    Snapshot collect()
+    {
+        Snapshot s;
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const auto &t : r.threads)
+        {
+            for (int i = 0; i < counter_count; ++i)
+                s.counters[i] += t->counters[i].load(std::memory_order_relaxed);
+            std::lock_guard<std::mutex> thread_lock(t->mutex);
+            for (const auto &[name, ns] : t->stage_ns)
+                add_stage(s.stage_ms, name, ns / 1e6);
+        }
+        return s;
+    }
+
+    void start_trace()
+    {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const auto &t : r.threads)
+        {
+            std::lock_guard<std::mutex> thread_lock(t->mutex);
+            t->scopes.clear();
+            t->counter_events.clear();
+        }
+        r.tracing = true;
+    }
+
+    bool stop_trace(const std::string &filename)
+    {
+        Registry &r = registry();
+        r.tracing = false;
+
+        std::ofstream out(filename, std::ios::binary);
+        if (!out.is_open())
+            return false;
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        auto separator = [&]
+        {
+            if (!first)
+                out << ",\n";
+            first = false;
+        };
+        char line[256];
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const auto &t : r.threads)
+        {
+            std::lock_guard<std::mutex> thread_lock(t->mutex);
+            for (const ScopeEvent &e : t->scopes)
+            {
+                separator();
+                std::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                              e.name, t->tid, e.start_ns / 1e3, e.duration_ns / 1e3);
+                out << line;
+            }
+            for (const CounterEvent &e : t->counter_events)
+            {
+                separator();
+                std::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{",
+                              e.name, t->tid, e.time_ns / 1e3);
+                out << line;
+                for (int i = 0; i < counter_count; ++i)
+                    out << (i ? "," : "") << '"' << counter_name(static_cast<Counter>(i)) << "\":" << e.values[i];
+                out << "}}";
+            }
+        }
+        out << "\n]}\n";
+        return out.good();
+    }
+
+    void add(Counter counter, std::uint64_t n)
+    {
+        auto &c = local().counters[static_cast<int>(counter)];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void trace_counters(const char *name)
+    {
+        if (!registry().tracing.load(std::memory_order_relaxed))
+            return;
+        ThreadData &t = local();
+        CounterEvent e{name, now_ns(), {}};
+        for (int i = 0; i < counter_count; ++i)
+        {
+            std::uint64_t v = t.counters[i].load(std::memory_order_relaxed);
+            e.values[i] = v - t.last_traced[i];
+            t.last_traced[i] = v;
+        }
+        std::lock_guard<std::mutex> lock(t.mutex);
+        t.counter_events.push_back(e);
+    }
+
+#ifdef NANORENDER_PROFILE
+    Scope::Scope(const char *name) : name(name), start_ns(now_ns())
+    {
+    }
+
+    Scope::~Scope()
+    {
+        std::uint64_t end = now_ns();
+        ThreadData &t = local();
+        std::lock_guard<std::mutex> lock(t.mutex);
+        auto stage = std::find_if(t.stage_ns.begin(), t.stage_ns.end(), [this](const auto &s)
+                                  { return s.first == name; });
+        if (stage == t.stage_ns.end())
+            t.stage_ns.emplace_back(name, end - start_ns);
+        else
+            stage->second += end - start_ns;
+        if (registry().tracing.load(std::memory_order_relaxed))
+            t.scopes.push_back({name, start_ns, end - start_ns});
+    }
+#endif
+}
@@ -0,0 +1,124 @@
+/// @file profiler.h
+/// @brief Scoped stage timers and pipeline counters.
+/*!
+    Built with `NANORENDER_PROFILE` defined (CMake option of the same name),
+    the macros below record:
+    - stage times: `PROFILE_SCOPE("raster")` times the enclosing block and adds
+      it to the stage's total; while a trace is running each scope is also
+      stored as a Chrome trace event (chrome://tracing, ui.perfetto.dev);
+    - counters: triangles submitted and culled, pixels depth-tested, written
+      and covered. Overdraw is pixels written per covered pixel, the same
+      figure as OverdrawStats::overdraw() in render.h.
+
+    Every thread records into its own buffers, so instrumented code never
+    contends on a lock; `collect()` sums all threads. Without the define the
+    macros expand to nothing and `Tally` is an empty type, so instrumented
+    kernels compile to the same code as uninstrumented ones.
+ */
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace profiler
+{
+    enum class Counter
+    {
+        TrianglesSubmitted,
+        TrianglesCulled,
+        PixelsTested,  ///< Covered by a triangle and depth-tested.
+        PixelsWritten, ///< Passed the depth test and wrote a color (or triangle ID); not the depth pre-pass.
+        PixelsCovered, ///< Distinct pixels covered at the end of a frame.
+        Count
+    };
+
+    constexpr int counter_count = static_cast<int>(Counter::Count);
+    const char *counter_name(Counter counter);
+
+#ifdef NANORENDER_PROFILE
+    constexpr bool enabled = true;
+#else
+    constexpr bool enabled = false;
+#endif
+
+    /// @brief Totals over all threads since the program started.
+    struct Snapshot
+    {
+        std::uint64_t counters[counter_count] = {};
+        std::vector<std::pair<const char *, double>> stage_ms; ///< Per stage name, in first-seen order.
+
+        std::uint64_t operator[](Counter counter) const { return counters[static_cast<int>(counter)]; }
+        double stage(const char *name) const;
+        /// @brief Pixels written per covered pixel (0 if nothing was covered).
+        double overdraw() const;
+        /// @brief Difference between two snapshots, e.g. one frame's worth.
+        Snapshot operator-(const Snapshot &earlier) const;
+    };
+
+    Snapshot collect();
+
+    /// @brief Start storing scope events for a trace (clears events of a previous trace).
+    void start_trace();
+    /// @brief Stop tracing and write the events as Chrome trace JSON.
+    /// @return False if the file can't be written.
+    bool stop_trace(const std::string &filename);
+
+    void add(Counter counter, std::uint64_t n);
+    /// @brief Emit a trace counter event with this thread's counter changes since its last call.
+    void trace_counters(const char *name);
+
+#ifdef NANORENDER_PROFILE
+    /// @brief Times its lifetime as stage `name`. `name` must be a string literal.
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        const char *name;
+        std::uint64_t start_ns;
+    };
+
+    /// @brief Local counter for hot loops, added to the thread's counter once at scope exit.
+    class Tally
+    {
+    public:
+        explicit Tally(Counter counter) : counter(counter) {}
+        ~Tally() { add(counter, n); }
+        Tally(const Tally &) = delete;
+        Tally &operator=(const Tally &) = delete;
+        void operator+=(std::uint64_t k) { n += k; }
+
+    private:
+        Counter counter;
+        std::uint64_t n = 0;
+    };
+#else
+    class Tally
+    {
+    public:
+        explicit Tally(Counter) {}
+        void operator+=(std::uint64_t) {}
+    };
+#endif
+}
+
+#ifdef NANORENDER_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ::profiler::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNT(counter, n) ::profiler::add(::profiler::Counter::counter, (n))
+#define PROFILE_TRACE_COUNTERS(name) ::profiler::trace_counters(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)0)
+#define PROFILE_TRACE_COUNTERS(name) ((void)0)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,400 @@
+/// @file raster_kernels.h
+/// @brief Template definitions of Renderer: the raster kernels and the shader plumbing.
+/*!
+    Included at the end of render.h so `Renderer::render_model` can be
+    instantiated for shaders defined outside the renderer. Not meant to be
+    included on its own.
+ */
+#ifndef RASTER_KERNELS_H
+#define RASTER_KERNELS_H
+
+#include <atomic>
+#include <cstring>
+#include "render.h"
+
+/// Marks per-pixel code. Each shader gets its own kernels, and past a few dozen of them GCC's
+/// inlining budget runs out and the fragment stage becomes a call per pixel.
+#if defined(_MSC_VER)
+#define RASTER_INLINE __forceinline
+#else
+#define RASTER_INLINE inline __attribute__((always_inline))
+#endif
+
+struct Renderer::DepthOnlyFragment
+{
+    static constexpr bool uniform = true;
+    TGAColor color{};
+    TGAColor shade(double, double, double) const { return color; }
+};
+
+/// Perspective-correct shading: the screen-space weights are scaled by each corner's 1 / w
+/// and renormalized, giving the weights of the point on the face itself.
+template <Shader S>
+struct Renderer::ShaderFragment
+{
+    static constexpr bool uniform = S::varyings == 0;
+    const S *shader;
+    typename S::Face constants{};
+    Varyings<S::varyings> corners[3]{};
+    float inv_w[3]{};
+    TGAColor color{}; ///< The face's color when `uniform`.
+
+    RASTER_INLINE TGAColor shade(double alpha, double beta, double gamma) const
+    {
+        if constexpr (uniform)
+            return color;
+        else
+        {
+            alpha *= inv_w[0];
+            beta *= inv_w[1];
+            gamma *= inv_w[2];
+            double sum = alpha + beta + gamma;
+            if (!(sum > 0))
+                return shader->fragment(constants, corners[0]); // degenerate face
+            alpha /= sum;
+            beta /= sum;
+            gamma /= sum;
+            Varyings<S::varyings> v;
+            for (int i = 0; i < S::varyings; ++i)
+                v[i] = static_cast<float>(alpha * corners[0][i] + beta * corners[1][i] + gamma * corners[2][i]);
+            return shader->fragment(constants, v);
+        }
+    }
+};
+
+template <Shader S, typename Fn>
+void Renderer::with_shader(const ScreenTriangle &t, const Model3D &model, Fn &&fn) const
+{
+    double area = square(t.ax, t.ay, t.bx, t.by, t.cx, t.cy);
+    if (area < 1)
+        return;
+    const S &shader = *static_cast<const S *>(bound.shader);
+    const ShaderFace face{model, t.face, {t.ax, t.bx, t.cx}, {t.ay, t.by, t.cy}, area};
+    ShaderFragment<S> fragment{&shader};
+    for (int k = 0; k < 3; ++k)
+        fragment.corners[k] = shader.vertex(shader_context, face, k);
+    fragment.constants = shader.face(shader_context, face, fragment.corners);
+    if constexpr (ShaderFragment<S>::uniform)
+        fragment.color = shader.fragment(fragment.constants, fragment.corners[0]);
+    else
+        std::copy(t.inv_w, t.inv_w + 3, fragment.inv_w);
+    fn(fragment);
+}
+
+template <Shader S>
+void Renderer::draw_shaded(size_t index, const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, const ClipRect &clip)
+{
+    const ScreenTriangle &t = screen_triangles[index];
+    with_shader<S>(t, model, [&](const ShaderFragment<S> &fragment)
+                   { rasterize(t.ax, t.ay, t.az, t.bx, t.by, t.bz, t.cx, t.cy, t.cz, target, fragment, zbuffer, clip); });
+}
+
+template <Shader S>
+void Renderer::draw_packed_shaded(size_t index, const Model3D &model)
+{
+    const ScreenTriangle &t = screen_triangles[index];
+    with_shader<S>(t, model, [&](const ShaderFragment<S> &fragment)
+                   { triangle_packed(t.ax, t.ay, t.az, t.bx, t.by, t.bz, t.cx, t.cy, t.cz, fragment); });
+}
+
+template <Shader S>
+void Renderer::shade_span(size_t index, const Model3D &model, const Framebuffer &target, int x0, int x1, int y)
+{
+    const ScreenTriangle &t = screen_triangles[index];
+    const int bpp = target.bpp();
+    with_shader<S>(t, model, [&](const ShaderFragment<S> &fragment)
+                   {
+                       if constexpr (ShaderFragment<S>::uniform)
+                       {
+                           for (int x = x0; x < x1; ++x)
+                               std::memcpy(target.pixel(x, y), fragment.color.bgra, bpp);
+                       }
+                       else
+                       {
+                           double triangle_sq = square(t.ax, t.ay, t.bx, t.by, t.cx, t.cy);
+                           for (int x = x0; x < x1; ++x)
+                           {
+                               // Same edge functions and weights as triangle_spans computes for this pixel.
+                               int ea = (t.bx - x) * (t.cy - y) - (t.cx - x) * (t.by - y);
+                               int eb = (x - t.ax) * (t.cy - t.ay) - (t.cx - t.ax) * (y - t.ay);
+                               int ec = (t.bx - t.ax) * (y - t.ay) - (x - t.ax) * (t.by - t.ay);
+                               double alpha = ea * 0.5 / triangle_sq;
+                               double beta = eb * 0.5 / triangle_sq;
+                               double gamma = ec * 0.5 / triangle_sq;
+                               std::memcpy(target.pixel(x, y), fragment.shade(alpha, beta, gamma).bgra, bpp);
+                           }
+                       } });
+}
+
+template <Shader S>
+void Renderer::render_model(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target, const S &shader)
+{
+    bound = {&shader, &Renderer::draw_shaded<S>, &Renderer::draw_packed_shaded<S>, &Renderer::shade_span<S>, S::varyings > 0};
+    render_bound(model, camera, buffer, target);
+    bound.shader = nullptr;
+}
+
+/// Kernel of the atomic strategy. Coverage and depth are computed as in triangle_spans;
+/// each covered pixel is committed with a compare-and-swap loop that only ever raises the
+/// word, so concurrent tasks can share the target without locks.
+template <typename Fragment>
+void Renderer::triangle_packed(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Fragment &fragment)
+{
+    int bb_min_x = std::max(std::min(std::min(ax, bx), cx), 0);
+    int bb_min_y = std::max(std::min(std::min(ay, by), cy), 0);
+    int bb_max_x = std::min(std::max(std::max(ax, bx), cx), width - 1);
+    int bb_max_y = std::min(std::max(std::max(ay, by), cy), height - 1);
+    double triangle_sq = square(ax, ay, bx, by, cx, cy);
+
+    if (triangle_sq < 1)
+        return;
+
+    if (bb_min_x > bb_max_x || bb_min_y > bb_max_y)
+        return;
+
+    const int da = by - cy, db = cy - ay, dc = ay - by;
+    profiler::Tally tested_px(profiler::Counter::PixelsTested), written_px(profiler::Counter::PixelsWritten);
+    std::uint64_t committed = 0;
+
+    for (int y = bb_min_y; y <= bb_max_y; y++)
+    {
+        int x = bb_min_x;
+        int ea = (bx - x) * (cy - y) - (cx - x) * (by - y);
+        int eb = (x - ax) * (cy - ay) - (cx - ax) * (y - ay);
+        int ec = (bx - ax) * (y - ay) - (x - ax) * (by - ay);
+        std::uint64_t *row = packed.data() + static_cast<size_t>(y) * width;
+
+        for (; x <= bb_max_x; x++, ea += da, eb += db, ec += dc)
+        {
+            if ((ea | eb | ec) < 0)
+                continue;
+            double alpha = ea * 0.5 / triangle_sq;
+            double beta = eb * 0.5 / triangle_sq;
+            double gamma = ec * 0.5 / triangle_sq;
+            std::uint32_t key = depth_key(alpha * az + beta * bz + gamma * cz);
+            tested_px += 1;
+
+            std::atomic_ref<std::uint64_t> cell(row[x]);
+            std::uint64_t old = cell.load(std::memory_order_relaxed);
+            if ((old >> 32) > key)
+                continue; // strictly farther: skip shading
+            std::uint32_t color;
+            std::memcpy(&color, fragment.shade(alpha, beta, gamma).bgra, sizeof(color));
+            std::uint64_t word = static_cast<std::uint64_t>(key) << 32 | color;
+            while (old < word && !cell.compare_exchange_weak(old, word, std::memory_order_relaxed))
+            {
+            }
+            if (old < word)
+            {
+                written_px += 1;
+                committed += 1;
+            }
+        }
+    }
+    count_fragments(committed, committed);
+}
+
+template <typename Fragment>
+void Renderer::rasterize(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, const Fragment &fragment, Zbuffer &zbuffer, const ClipRect &clip)
+{
+    if (target.layout() != zbuffer.layout())
+        throw std::invalid_argument("color and depth targets must use the same layout");
+    switch (depth_pass)
+    {
+    case DepthPass::Normal:
+        rasterize_pass<DepthPass::Normal>(ax, ay, az, bx, by, bz, cx, cy, cz, target, fragment, zbuffer, clip);
+        break;
+    case DepthPass::DepthOnly:
+        // Writes no color, so every fragment type can share one instantiation.
+        rasterize_pass<DepthPass::DepthOnly>(ax, ay, az, bx, by, bz, cx, cy, cz, target, DepthOnlyFragment{}, zbuffer, clip);
+        break;
+    case DepthPass::EqualDepth:
+        rasterize_pass<DepthPass::EqualDepth>(ax, ay, az, bx, by, bz, cx, cy, cz, target, fragment, zbuffer, clip);
+        break;
+    }
+}
+
+template <Renderer::DepthPass Pass, typename Fragment>
+void Renderer::rasterize_pass(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, const Fragment &fragment, Zbuffer &zbuffer, const ClipRect &clip)
+{
+    bool tiled = target.layout() == TargetLayout::Tiled;
+    switch (target.bpp())
+    {
+    case TGAImage::GRAYSCALE:
+        tiled ? triangle_tiles<Pass, 1>(ax, ay, az, bx, by, bz, cx, cy, cz, target, fragment, zbuffer, clip)
+              : triangle_spans<Pass, 1>(ax, ay, az, bx, by, bz, cx, cy, cz, target, fragment, zbuffer, clip);
+        break;
+    case TGAImage::RGB:
+        tiled ? triangle_tiles<Pass, 3>(ax, ay, az, bx, by, bz, cx, cy, cz, target, fragment, zbuffer, clip)
+              : triangle_spans<Pass, 3>(ax, ay, az, bx, by, bz, cx, cy, cz, target, fragment, zbuffer, clip);
+        break;
+    case TGAImage::RGBA:
+        tiled ? triangle_tiles<Pass, 4>(ax, ay, az, bx, by, bz, cx, cy, cz, target, fragment, zbuffer, clip)
+              : triangle_spans<Pass, 4>(ax, ay, az, bx, by, bz, cx, cy, cz, target, fragment, zbuffer, clip);
+        break;
+    }
+}
+
+/// Scanline rasterizer. Edge functions are stepped with integer adds along each
+/// row and, for uniform fragments, passing pixels are written as spans, so there
+/// is no per-pixel bounds check or `square()` call. The barycentric weights and the interpolated
+/// depth are computed exactly as `barycentric()` does, so results match it bit for bit
+/// (and the EqualDepth pass sees the same depth the DepthOnly pass stored).
+template <Renderer::DepthPass Pass, int BPP, typename Fragment>
+void Renderer::triangle_spans(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, const Fragment &fragment, Zbuffer &zbuffer, const ClipRect &clip)
+{
+    int bb_min_x = std::max(std::min(std::min(ax, bx), cx), clip.x0);
+    int bb_min_y = std::max(std::min(std::min(ay, by), cy), clip.y0);
+    int bb_max_x = std::min(std::max(std::max(ax, bx), cx), clip.x1);
+    int bb_max_y = std::min(std::max(std::max(ay, by), cy), clip.y1);
+    double triangle_sq = square(ax, ay, bx, by, cx, cy);
+
+    if (triangle_sq < 1)
+        return;
+
+    if (bb_min_x > bb_max_x || bb_min_y > bb_max_y)
+        return;
+
+    // Twice the signed areas square(p, b, c), square(a, p, c), square(a, b, p) and their x steps.
+    const int da = by - cy, db = cy - ay, dc = ay - by;
+    profiler::Tally tested_px(profiler::Counter::PixelsTested), written_px(profiler::Counter::PixelsWritten);
+    std::uint64_t depth_count = 0, shaded_count = 0;
+
+    for (int y = bb_min_y; y <= bb_max_y; y++)
+    {
+        int x = bb_min_x;
+        int ea = (bx - x) * (cy - y) - (cx - x) * (by - y);
+        int eb = (x - ax) * (cy - ay) - (cx - ax) * (y - ay);
+        int ec = (bx - ax) * (y - ay) - (x - ax) * (by - ay);
+
+        double *zrow = zbuffer.row(y);
+        std::uint8_t *crow = target.row(y);
+        std::uint8_t *mrow = nullptr;
+        if constexpr (Pass == DepthPass::EqualDepth)
+            mrow = shaded_mask.data() + (zrow - zbuffer.data());
+        int run_start = -1;
+
+        for (; x <= bb_max_x; x++, ea += da, eb += db, ec += dc)
+        {
+            bool written = false;
+            if ((ea | eb | ec) >= 0)
+            {
+                double alpha = ea * 0.5 / triangle_sq;
+                double beta = eb * 0.5 / triangle_sq;
+                double gamma = ec * 0.5 / triangle_sq;
+                double z = alpha * az + beta * bz + gamma * cz;
+                tested_px += 1;
+                if constexpr (Pass == DepthPass::EqualDepth)
+                    written = zrow[x] == z && !mrow[x];
+                else if (zrow[x] < z)
+                {
+                    zrow[x] = z;
+                    written = Pass == DepthPass::Normal;
+                    depth_count += 1;
+                }
+                if (written)
+                {
+                    written_px += 1;
+                    shaded_count += 1;
+                    if constexpr (Pass == DepthPass::EqualDepth)
+                        mrow[x] = 1;
+                    if constexpr (!Fragment::uniform)
+                        std::memcpy(crow + x * BPP, fragment.shade(alpha, beta, gamma).bgra, BPP);
+                }
+            }
+            if constexpr (Fragment::uniform)
+            {
+                if (written)
+                {
+                    if (run_start < 0)
+                        run_start = x;
+                }
+                else if (run_start >= 0)
+                {
+                    fill_pixels(crow + run_start * BPP, x - run_start, fragment.color, BPP);
+                    run_start = -1;
+                }
+            }
+        }
+        if constexpr (Fragment::uniform)
+            if (run_start >= 0)
+                fill_pixels(crow + run_start * BPP, bb_max_x + 1 - run_start, fragment.color, BPP);
+    }
+    count_fragments(depth_count, shaded_count);
+}
+
+/// Tile-order rasterizer for tiled targets: the bounding box is walked one 8x8
+/// tile at a time, so every depth and color access lands in the tile's few cache
+/// lines. Coverage and depth are computed as in triangle_spans.
+template <Renderer::DepthPass Pass, int BPP, typename Fragment>
+void Renderer::triangle_tiles(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, const Fragment &fragment, Zbuffer &zbuffer, const ClipRect &clip)
+{
+    int bb_min_x = std::max(std::min(std::min(ax, bx), cx), clip.x0);
+    int bb_min_y = std::max(std::min(std::min(ay, by), cy), clip.y0);
+    int bb_max_x = std::min(std::max(std::max(ax, bx), cx), clip.x1);
+    int bb_max_y = std::min(std::max(std::max(ay, by), cy), clip.y1);
+    double triangle_sq = square(ax, ay, bx, by, cx, cy);
+
+    if (triangle_sq < 1)
+        return;
+
+    if (bb_min_x > bb_max_x || bb_min_y > bb_max_y)
+        return;
+
+    const int da = by - cy, db = cy - ay, dc = ay - by;
+    profiler::Tally tested_px(profiler::Counter::PixelsTested), written_px(profiler::Counter::PixelsWritten);
+    std::uint64_t depth_count = 0, shaded_count = 0;
+
+    for (int ty = bb_min_y / tile_size * tile_size; ty <= bb_max_y; ty += tile_size)
+    {
+        int y0 = std::max(ty, bb_min_y), y1 = std::min(ty + tile_size - 1, bb_max_y);
+        for (int tx = bb_min_x / tile_size * tile_size; tx <= bb_max_x; tx += tile_size)
+        {
+            int x0 = std::max(tx, bb_min_x), x1 = std::min(tx + tile_size - 1, bb_max_x);
+            // Tile origins; morton_offset() gives the position inside the tile.
+            double *ztile = zbuffer.data() + zbuffer.index(tx, ty);
+            std::uint8_t *ctile = target.pixel(tx, ty);
+            std::uint8_t *mtile = nullptr;
+            if constexpr (Pass == DepthPass::EqualDepth)
+                mtile = shaded_mask.data() + zbuffer.index(tx, ty);
+            for (int y = y0; y <= y1; y++)
+            {
+                int ea = (bx - x0) * (cy - y) - (cx - x0) * (by - y);
+                int eb = (x0 - ax) * (cy - ay) - (cx - ax) * (y - ay);
+                int ec = (bx - ax) * (y - ay) - (x0 - ax) * (by - ay);
+                for (int x = x0; x <= x1; x++, ea += da, eb += db, ec += dc)
+                {
+                    if ((ea | eb | ec) < 0)
+                        continue;
+                    double alpha = ea * 0.5 / triangle_sq;
+                    double beta = eb * 0.5 / triangle_sq;
+                    double gamma = ec * 0.5 / triangle_sq;
+                    double z = alpha * az + beta * bz + gamma * cz;
+                    int offset = morton_offset(x, y);
+                    tested_px += 1;
+                    if constexpr (Pass == DepthPass::EqualDepth)
+                    {
+                        if (ztile[offset] != z || mtile[offset])
+                            continue;
+                        mtile[offset] = 1;
+                    }
+                    else if (ztile[offset] < z)
+                    {
+                        ztile[offset] = z;
+                        depth_count += 1;
+                        if constexpr (Pass == DepthPass::DepthOnly)
+                            continue;
+                    }
+                    else
+                        continue;
+                    shaded_count += 1;
+                    std::memcpy(ctile + offset * BPP, fragment.shade(alpha, beta, gamma).bgra, BPP);
+                }
+            }
+        }
+    }
+    written_px += shaded_count;
+    count_fragments(depth_count, shaded_count);
+}
+
+#endif // RASTER_KERNELS_H
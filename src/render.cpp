@@ -1,5 +1,9 @@
 #include "render.h"
 
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
 Renderer::Renderer()
 {
 }
@@ -28,25 +32,368 @@ std::tuple<int, int, int> Renderer::project(vec3f vert, int width, int height)
             (vert.z + 1.) * 255 / 2};
 }
 
-float Renderer::light(vec3f v0, vec3f v1, vec3f v2)
+void Renderer::render_model(const Model3D &model, Camera &camera, Zbuffer &buffer, TGAImage &image)
 {
-    vec3f light_dir(0, 0, -1);
-    light_dir.normalize();
-    vec3f normal = (v2 - v0) ^ (v1 - v0);
-    normal.normalize();
-    return normal * light_dir;
+    render_model(model, camera, buffer, Framebuffer::from_image(image));
 }
 
-void Renderer::render_model(const Model3D &model, Camera &camera, Zbuffer &buffer, TGAImage &image)
+template <int Lights>
+void Renderer::render_lit(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target)
+{
+    const bool textured = has_texture(model);
+    switch (shading)
+    {
+    case ShadingMode::Flat:
+        if (textured)
+            render_model(model, camera, buffer, target, TexturedShader<FlatShader<Lights>>{});
+        else
+            render_model(model, camera, buffer, target, FlatShader<Lights>{});
+        break;
+    case ShadingMode::Gouraud:
+        if (textured)
+            render_model(model, camera, buffer, target, TexturedShader<GouraudShader<Lights>>{});
+        else
+            render_model(model, camera, buffer, target, GouraudShader<Lights>{});
+        break;
+    case ShadingMode::Phong:
+    {
+        const bool positional = std::any_of(lights.begin(), lights.end(), [](const Light &light)
+                                            { return light.type != LightType::Directional; });
+        if (textured && positional)
+            render_model(model, camera, buffer, target, TexturedShader<PhongShader<Lights, true>>{});
+        else if (textured)
+            render_model(model, camera, buffer, target, TexturedShader<PhongShader<Lights, false>>{});
+        else if (positional)
+            render_model(model, camera, buffer, target, PhongShader<Lights, true>{});
+        else
+            render_model(model, camera, buffer, target, PhongShader<Lights, false>{});
+        break;
+    }
+    }
+}
+
+void Renderer::render_model(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target)
+{
+    // Shaders are compiled for 1, 2, 4 and 8 lanes; the lanes past the last light are dark.
+    if (lights.size() <= 1)
+        render_lit<1>(model, camera, buffer, target);
+    else if (lights.size() <= 2)
+        render_lit<2>(model, camera, buffer, target);
+    else if (lights.size() <= 4)
+        render_lit<4>(model, camera, buffer, target);
+    else
+        render_lit<8>(model, camera, buffer, target);
+}
+
+bool Renderer::has_texture(const Model3D &model) const
+{
+    return texture && !texture->empty() && model.render_uv.size() == model.render_obj.size();
+}
+
+void Renderer::render_bound(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target)
+{
+    PROFILE_SCOPE("render_model");
+    depth_writes = shaded_fragments = 0;
+    temporal_stats = {};
+    if (lights.size() > static_cast<size_t>(LightLanes::max_lights))
+        throw std::invalid_argument("too many lights");
+    shader_context.texture = has_texture(model) ? texture : nullptr;
+    if (lights.empty())
+    {
+        // Headlight: along the view axis, away from the eye. With no model transform, model space is world space.
+        Light headlight;
+        headlight.direction = camera.zax * -1.f;
+        shader_context.lights.set(&headlight, 1);
+    }
+    else
+        shader_context.lights.set(lights.data(), static_cast<int>(lights.size()));
+    if (temporal_refresh > 0 && cache_reusable(model, target))
+        render_reprojected(model, camera, buffer, target);
+    else
+    {
+        render_frame(model, camera, buffer, target);
+        if (temporal_refresh > 0)
+            store_frame(model, camera, buffer, target);
+        else
+            cache.valid = false;
+    }
+
+    if (profiler::enabled || measure_overdraw)
+    {
+        std::uint64_t covered = 0;
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                covered += buffer.get(x, y) != -std::numeric_limits<double>::infinity();
+        if (measure_overdraw)
+            overdraw_stats = {depth_writes, shaded_fragments, covered};
+        PROFILE_COUNT(PixelsCovered, covered);
+        PROFILE_TRACE_COUNTERS("render_model");
+    }
+}
+
+void Renderer::render_frame(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target)
+{
+    const bool culling = occlusion_culling && !model.render_obj.empty() &&
+                         model.cluster_bounds.size() == (model.render_obj.size() + Model3D::cluster_size - 1) / Model3D::cluster_size;
+    if (culling)
+        cull_clusters(model, camera);
+    else
+        transform_faces(model, camera);
+    if (overdraw_mode == OverdrawMode::SortFrontToBack)
+        sort_front_to_back(0);
+
+    // With a visibility buffer the raster pass writes triangle IDs instead of colors.
+    const Framebuffer raster_target = visibility_buffer ? clear_ids(target.layout()) : target;
+    bool late = false;
+    {
+        PROFILE_SCOPE("raster");
+        // Sort-last layers and the atomic target resolve depth after the fact, so the
+        // equal-depth pass could not see the final depth: a pre-pass uses tiles.
+        const bool prepass = overdraw_mode == OverdrawMode::DepthPrepass;
+        depth_pass = prepass ? DepthPass::DepthOnly : DepthPass::Normal;
+        raster(model, raster_target, buffer, 0, prepass);
+        if (culling && !culled_clusters.empty())
+        {
+            const size_t first = screen_triangles.size();
+            retest_clusters(model, camera, buffer);
+            late = screen_triangles.size() > first;
+            if (late && overdraw_mode == OverdrawMode::SortFrontToBack)
+                sort_front_to_back(first);
+            if (late)
+                raster(model, raster_target, buffer, first, prepass);
+        }
+        if (prepass)
+        {
+            shaded_mask.assign(buffer.size(), 0);
+            depth_pass = DepthPass::EqualDepth;
+            raster(model, raster_target, buffer, 0, true);
+        }
+        depth_pass = DepthPass::Normal;
+    }
+    if (culling)
+        update_history(camera, buffer, !culled_clusters.empty() && !late);
+    else
+        history_valid = false;
+    if (visibility_buffer)
+        shade_ids(model, raster_target, target);
+}
+
+void Renderer::raster(const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, size_t first, bool tiles_only)
+{
+    const size_t pixels = static_cast<size_t>(width) * height;
+    const bool sort_last = strategy == RasterStrategy::SortLast ||
+                           (strategy == RasterStrategy::Auto && (screen_triangles.size() - first) * sort_last_max_area > pixels);
+    if (jobs && jobs->threads() > 1 && !tiles_only && strategy == RasterStrategy::Atomic)
+        raster_packed(model, target, zbuffer, first);
+    else if (jobs && jobs->threads() > 1)
+        sort_last && !tiles_only ? raster_sort_last(model, target, zbuffer, first) : raster_binned(model, target, zbuffer, first);
+    else
+    {
+        const ClipRect screen{0, 0, width - 1, height - 1};
+        for (size_t i = first; i < screen_triangles.size(); ++i)
+            draw(i, model, target, zbuffer, screen);
+    }
+}
+
+/// Counting sort (a one-digit radix sort) on the sum of the vertex depths, which are
+/// whole numbers in 0..255, so the key needs no further quantizing. Larger depths are
+/// nearer. Stable, so triangles at equal depth keep their face order.
+void Renderer::sort_front_to_back(size_t first)
+{
+    PROFILE_SCOPE("sort");
+    static constexpr int max_key = 3 * 255;
+    auto key = [](const ScreenTriangle &t)
+    { return max_key - std::clamp(t.az + t.bz + t.cz, 0, max_key); };
+
+    const auto begin = screen_triangles.begin() + first;
+    depth_histogram.assign(max_key + 2, 0);
+    for (auto t = begin; t != screen_triangles.end(); ++t)
+        ++depth_histogram[key(*t) + 1];
+    for (int k = 1; k <= max_key + 1; ++k)
+        depth_histogram[k] += depth_histogram[k - 1];
+    sorted_triangles.resize(screen_triangles.size() - first);
+    for (auto t = begin; t != screen_triangles.end(); ++t)
+        sorted_triangles[depth_histogram[key(*t)]++] = *t;
+    std::copy(sorted_triangles.begin(), sorted_triangles.end(), begin);
+}
+
+void Renderer::count_fragments(std::uint64_t depth, std::uint64_t shaded)
+{
+    if (!measure_overdraw)
+        return;
+    std::atomic_ref<std::uint64_t>(depth_writes).fetch_add(depth, std::memory_order_relaxed);
+    std::atomic_ref<std::uint64_t>(shaded_fragments).fetch_add(shaded, std::memory_order_relaxed);
+}
+
+void Renderer::draw(size_t index, const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, const ClipRect &clip)
+{
+    const ScreenTriangle &t = screen_triangles[index];
+    if (visibility_buffer || depth_pass == DepthPass::DepthOnly)
+    {
+        // A depth-only pass ignores the color, so skip the texture setup.
+        triangle(t.ax, t.ay, t.az, t.bx, t.by, t.bz, t.cx, t.cy, t.cz, target, id_color(index), zbuffer, clip);
+        return;
+    }
+    (this->*bound.draw)(index, model, target, zbuffer, clip);
+}
+
+int Renderer::bin_triangles(size_t first, int tile)
+{
+    PROFILE_SCOPE("bin");
+    const int bins_x = (width + tile - 1) / tile;
+    const int bins_y = (height + tile - 1) / tile;
+    bins.resize(static_cast<size_t>(bins_x) * bins_y);
+    for (auto &bin : bins)
+        bin.clear();
+
+    // Screen coordinates are already clamped to the target, so bounding boxes are too.
+    for (size_t i = first; i < screen_triangles.size(); ++i)
+    {
+        const ScreenTriangle &t = screen_triangles[i];
+        int x0 = std::min({t.ax, t.bx, t.cx}) / tile, x1 = std::max({t.ax, t.bx, t.cx}) / tile;
+        int y0 = std::min({t.ay, t.by, t.cy}) / tile, y1 = std::max({t.ay, t.by, t.cy}) / tile;
+        for (int by = y0; by <= y1; ++by)
+            for (int bx = x0; bx <= x1; ++bx)
+                bins[static_cast<size_t>(by) * bins_x + bx].push_back(static_cast<std::uint32_t>(i));
+    }
+    return bins_x;
+}
+
+void Renderer::raster_binned(const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, size_t first)
+{
+    const int bins_x = bin_triangles(first, bin_size);
+    jobs->parallel_for(0, bins.size(), 1, [&](size_t first_bin, size_t last_bin)
+                       {
+                           for (size_t b = first_bin; b < last_bin; ++b)
+                           {
+                               int bx = static_cast<int>(b % bins_x) * bin_size, by = static_cast<int>(b / bins_x) * bin_size;
+                               const ClipRect clip{bx, by, std::min(bx + bin_size, width) - 1, std::min(by + bin_size, height) - 1};
+                               for (std::uint32_t i : bins[b])
+                                   draw(i, model, target, zbuffer, clip);
+                           } });
+}
+
+void Renderer::raster_sort_last(const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, size_t first)
+{
+    const size_t n = screen_triangles.size() - first;
+    const size_t ranges = std::min(jobs->threads(), std::max<size_t>(n, 1));
+    const TargetLayout layout = target.layout();
+    const int bpp = target.bpp();
+    if (layers.size() != ranges - 1 || (!layers.empty() && (layers[0].color.width() != width || layers[0].color.height() != height ||
+                                                            layers[0].color.bpp() != bpp || layers[0].color.layout() != layout)))
+    {
+        layers.clear();
+        layers.reserve(ranges - 1);
+        for (size_t i = 1; i < ranges; ++i)
+        {
+            Layer &layer = layers.emplace_back(Layer{Zbuffer(width, height, layout), {}, {}, {}});
+            if (layout == TargetLayout::Tiled)
+            {
+                layer.pixels.resize(static_cast<size_t>(tile_count(width)) * tile_count(height) * tile_size * tile_size * bpp);
+                layer.color = Framebuffer::tiled(layer.pixels.data(), width, height, bpp);
+            }
+            else
+            {
+                layer.pixels.resize(static_cast<size_t>(width) * height * bpp);
+                layer.color = Framebuffer(layer.pixels.data(), width, height, bpp, static_cast<std::ptrdiff_t>(width) * bpp);
+            }
+        }
+    }
+
+    // Range 0 draws straight into the target; the others into their layer. Color
+    // needs no clearing: the merge only reads pixels whose depth was written.
+    const ClipRect screen{0, 0, width - 1, height - 1};
+    jobs->parallel_for(0, ranges, 1, [&](size_t first_range, size_t last_range)
+                       {
+                           for (size_t r = first_range; r < last_range; ++r)
+                           {
+                               size_t begin = first + n * r / ranges, end = first + n * (r + 1) / ranges;
+                               if (r == 0)
+                               {
+                                   for (size_t i = begin; i < end; ++i)
+                                       draw(i, model, target, zbuffer, screen);
+                                   continue;
+                               }
+                               Layer &layer = layers[r - 1];
+                               layer.depth.clear();
+                               layer.bounds = {width, height, -1, -1};
+                               for (size_t i = begin; i < end; ++i)
+                               {
+                                   const ScreenTriangle &t = screen_triangles[i];
+                                   layer.bounds.x0 = std::min({layer.bounds.x0, t.ax, t.bx, t.cx});
+                                   layer.bounds.y0 = std::min({layer.bounds.y0, t.ay, t.by, t.cy});
+                                   layer.bounds.x1 = std::max({layer.bounds.x1, t.ax, t.bx, t.cx});
+                                   layer.bounds.y1 = std::max({layer.bounds.y1, t.ay, t.by, t.cy});
+                                   draw(i, model, layer.color, layer.depth, screen);
+                               }
+                           } });
+
+    PROFILE_SCOPE("merge");
+    jobs->parallel_for(0, height, 16, [&](size_t first_row, size_t last_row)
+                       {
+                           for (int y = static_cast<int>(first_row); y < static_cast<int>(last_row); ++y)
+                               for (const Layer &layer : layers)
+                               {
+                                   if (y < layer.bounds.y0 || y > layer.bounds.y1)
+                                       continue;
+                                   // Strictly nearer only: on a tie the earlier range keeps the pixel.
+                                   for (int x = layer.bounds.x0; x <= layer.bounds.x1; ++x)
+                                   {
+                                       size_t i = zbuffer.index(x, y);
+                                       double z = layer.depth.get(x, y);
+                                       if (zbuffer.data()[i] < z)
+                                       {
+                                           zbuffer.data()[i] = z;
+                                           std::memcpy(target.pixel(x, y), layer.color.pixel(x, y), bpp);
+                                       }
+                                   }
+                               } });
+}
+
+void Renderer::transform_faces(const Model3D &model, Camera &camera)
 {
-    for (const auto &face : model.render_obj)
+    PROFILE_SCOPE("transform");
+    constexpr size_t faces_per_task = 2048;
+    const size_t faces = model.render_obj.size();
+    screen_triangles.clear();
+    if (!jobs || jobs->threads() == 1 || faces <= faces_per_task)
+        transform_range(model, camera, 0, faces, screen_triangles);
+    else
     {
+        // Fixed-size chunks, concatenated in order, keep the triangles in face order.
+        chunk_triangles.resize((faces + faces_per_task - 1) / faces_per_task);
+        jobs->parallel_for(0, chunk_triangles.size(), 1, [&](size_t first, size_t last)
+                           {
+                               for (size_t c = first; c < last; ++c)
+                               {
+                                   chunk_triangles[c].clear();
+                                   transform_range(model, camera, c * faces_per_task, std::min(faces, (c + 1) * faces_per_task), chunk_triangles[c]);
+                               } });
+        for (const auto &chunk : chunk_triangles)
+            screen_triangles.insert(screen_triangles.end(), chunk.begin(), chunk.end());
+    }
+    PROFILE_COUNT(TrianglesSubmitted, faces);
+    PROFILE_COUNT(TrianglesCulled, faces - screen_triangles.size());
+}
+
+void Renderer::transform_range(const Model3D &model, Camera &camera, size_t first, size_t last, std::vector<ScreenTriangle> &out)
+{
+    for (size_t i = first; i < last; ++i)
+    {
+        const auto &face = model.render_obj[i];
 
         auto nf0 = camera.view_persp(face[0]);
         auto nf1 = camera.view_persp(face[1]);
         auto nf2 = camera.view_persp(face[2]);
 
-        float intensity = light(nf0, nf1, nf2);
+        // Counter-clockwise on screen faces the viewer; also drops degenerate faces.
+        float winding = (nf1.x - nf0.x) * (nf2.y - nf0.y) - (nf1.y - nf0.y) * (nf2.x - nf0.x);
+        if (!(winding > 0))
+            continue;
+
+        float inv_w[3] = {1.f, 1.f, 1.f};
+        for (int k = 0; bound.varyings && k < 3; ++k)
+            inv_w[k] = 1.f / camera.clip_w(face[k]);
 
         auto [ax, ay, az] = camera.screen(nf0);
         auto [bx, by, bz] = camera.screen(nf1);
@@ -59,59 +406,629 @@ void Renderer::render_model(const Model3D &model, Camera &camera, Zbuffer &buffe
         cx = std::clamp(cx, 0, width - 1);
         cy = std::clamp(cy, 0, height - 1);
 
-        if (intensity > 0)
+        out.push_back({ax, ay, az, bx, by, bz, cx, cy, cz, {inv_w[0], inv_w[1], inv_w[2]}, static_cast<std::uint32_t>(i)});
+    }
+}
+
+namespace
+{
+    Matrix<4, 4, double> to_double(const mat4 &m)
+    {
+        Matrix<4, 4, double> d;
+        for (size_t i = 0; i < 4; ++i)
+            for (size_t j = 0; j < 4; ++j)
+                d[i][j] = m[i][j];
+        return d;
+    }
+
+    /// World position to screen position (before the divide by w).
+    Matrix<4, 4, double> world_to_screen(const Camera &camera)
+    {
+        return to_double(camera.screen_matrix) * to_double(camera.persp_matrix) * to_double(camera.view_matrix);
+    }
+}
+
+void Renderer::transform_clusters(const Model3D &model, Camera &camera, const std::vector<std::uint32_t> &clusters)
+{
+    PROFILE_SCOPE("transform");
+    const size_t faces = model.render_obj.size();
+    [[maybe_unused]] const size_t before = screen_triangles.size();
+    auto range = [&](std::uint32_t c)
+    { return std::pair{c * Model3D::cluster_size, std::min(faces, (c + 1) * Model3D::cluster_size)}; };
+    if (!jobs || jobs->threads() == 1)
+        for (std::uint32_t c : clusters)
+            transform_range(model, camera, range(c).first, range(c).second, screen_triangles);
+    else
+    {
+        // One list per cluster, concatenated in order, as in transform_faces.
+        chunk_triangles.resize(std::max(chunk_triangles.size(), clusters.size()));
+        jobs->parallel_for(0, clusters.size(), 8, [&](size_t first, size_t last)
+                           {
+                               for (size_t i = first; i < last; ++i)
+                               {
+                                   chunk_triangles[i].clear();
+                                   transform_range(model, camera, range(clusters[i]).first, range(clusters[i]).second, chunk_triangles[i]);
+                               } });
+        for (size_t i = 0; i < clusters.size(); ++i)
+            screen_triangles.insert(screen_triangles.end(), chunk_triangles[i].begin(), chunk_triangles[i].end());
+    }
+    size_t submitted = 0;
+    for (std::uint32_t c : clusters)
+        submitted += range(c).second - range(c).first;
+    PROFILE_COUNT(TrianglesSubmitted, submitted);
+    PROFILE_COUNT(TrianglesCulled, submitted - (screen_triangles.size() - before));
+}
+
+void Renderer::cull_clusters(const Model3D &model, Camera &camera)
+{
+    const size_t clusters = model.cluster_bounds.size();
+    visible_clusters.clear();
+    culled_clusters.clear();
+    {
+        PROFILE_SCOPE("occlusion");
+        const bool have_history = history_valid && history.w == (width + occlusion_cell - 1) / occlusion_cell &&
+                                  history.h == (height + occlusion_cell - 1) / occlusion_cell;
+        if (have_history)
         {
-            TGAColor actual_color = {intensity * 255, intensity * 255, intensity * 255, 255};
-            triangle(ax, ay, az, bx, by, bz, cx, cy, cz, image, actual_color, buffer, width, height);
+            reproject_history(camera);
+            build_pyramid();
         }
+        for (size_t c = 0; c < clusters; ++c)
+            (have_history && occluded(model.cluster_bounds[c], camera) ? culled_clusters : visible_clusters).push_back(static_cast<std::uint32_t>(c));
     }
+    occlusion_stats = {clusters, culled_clusters.size(), 0};
+    screen_triangles.clear();
+    transform_clusters(model, camera, visible_clusters);
+}
+
+void Renderer::retest_clusters(const Model3D &model, Camera &camera, Zbuffer &zbuffer)
+{
+    {
+        PROFILE_SCOPE("occlusion");
+        pyramid.resize(std::max<size_t>(pyramid.size(), 1));
+        build_depth_level(zbuffer, pyramid[0]);
+        build_pyramid();
+        visible_clusters.clear();
+        for (std::uint32_t c : culled_clusters)
+            if (!occluded(model.cluster_bounds[c], camera))
+                visible_clusters.push_back(c);
+    }
+    occlusion_stats.late = visible_clusters.size();
+    occlusion_stats.culled -= visible_clusters.size();
+    transform_clusters(model, camera, visible_clusters);
+}
+
+void Renderer::update_history(Camera &camera, Zbuffer &zbuffer, bool pyramid_current)
+{
+    PROFILE_SCOPE("occlusion");
+    if (pyramid_current)
+        history = pyramid[0]; // the second pass drew nothing, so its level 0 is the final depth
+    else
+        build_depth_level(zbuffer, history);
+    auto inverse = world_to_screen(camera).inverse();
+    history_valid = inverse.has_value();
+    if (history_valid)
+        history_from_screen = *inverse;
+}
+
+void Renderer::build_depth_level(Zbuffer &zbuffer, DepthLevel &level)
+{
+    level.w = (width + occlusion_cell - 1) / occlusion_cell;
+    level.h = (height + occlusion_cell - 1) / occlusion_cell;
+    level.depth.resize(static_cast<size_t>(level.w) * level.h);
+    auto cell_rows = [&](size_t first, size_t last)
+    {
+        for (int cy = static_cast<int>(first); cy < static_cast<int>(last); ++cy)
+            for (int cx = 0; cx < level.w; ++cx)
+            {
+                double farthest = std::numeric_limits<double>::infinity();
+                for (int y = cy * occlusion_cell; y < std::min((cy + 1) * occlusion_cell, height); ++y)
+                    for (int x = cx * occlusion_cell; x < std::min((cx + 1) * occlusion_cell, width); ++x)
+                        farthest = std::min(farthest, zbuffer.get(x, y));
+                level.depth[static_cast<size_t>(cy) * level.w + cx] = farthest;
+            }
+    };
+    if (jobs)
+        jobs->parallel_for(0, level.h, 4, cell_rows);
+    else
+        cell_rows(0, level.h);
+}
+
+/// Moves each history cell's farthest depth, taken at the cell's center, into the new
+/// camera's view. Cells that receive several samples keep the farthest; cells that
+/// receive none (disocclusions, stretched regions) hide nothing.
+void Renderer::reproject_history(Camera &camera)
+{
+    const Matrix<4, 4, double> reproject = world_to_screen(camera) * history_from_screen;
+    pyramid.resize(std::max<size_t>(pyramid.size(), 1));
+    DepthLevel &level = pyramid[0];
+    level.w = history.w;
+    level.h = history.h;
+    level.depth.assign(history.depth.size(), std::numeric_limits<double>::infinity());
+    for (int hy = 0; hy < history.h; ++hy)
+        for (int hx = 0; hx < history.w; ++hx)
+        {
+            double z = history.depth[static_cast<size_t>(hy) * history.w + hx];
+            if (z == -std::numeric_limits<double>::infinity())
+                continue;
+            double sx = (hx * occlusion_cell + std::min((hx + 1) * occlusion_cell, width)) * 0.5;
+            double sy = (hy * occlusion_cell + std::min((hy + 1) * occlusion_cell, height)) * 0.5;
+            vec4d p = reproject * vec4d{sx, sy, z, 1.};
+            if (!(p.w > 0))
+                continue;
+            double x = p.x / p.w, y = p.y / p.w;
+            if (!(x >= 0 && x < width && y >= 0 && y < height))
+                continue;
+            double &cell = level.depth[static_cast<size_t>(y / occlusion_cell) * level.w + static_cast<size_t>(x / occlusion_cell)];
+            cell = std::min(cell, p.z / p.w);
+        }
+    for (double &cell : level.depth)
+        if (cell == std::numeric_limits<double>::infinity())
+            cell = -std::numeric_limits<double>::infinity();
+}
+
+void Renderer::build_pyramid()
+{
+    size_t l = 1;
+    for (; pyramid[l - 1].w > 1 || pyramid[l - 1].h > 1; ++l)
+    {
+        if (pyramid.size() <= l)
+            pyramid.emplace_back();
+        const DepthLevel &below = pyramid[l - 1];
+        DepthLevel &level = pyramid[l];
+        level.w = (below.w + 1) / 2;
+        level.h = (below.h + 1) / 2;
+        level.depth.resize(static_cast<size_t>(level.w) * level.h);
+        for (int y = 0; y < level.h; ++y)
+            for (int x = 0; x < level.w; ++x)
+            {
+                double farthest = std::numeric_limits<double>::infinity();
+                for (int sy = 2 * y; sy < std::min(2 * y + 2, below.h); ++sy)
+                    for (int sx = 2 * x; sx < std::min(2 * x + 2, below.w); ++sx)
+                        farthest = std::min(farthest, below.depth[static_cast<size_t>(sy) * below.w + sx]);
+                level.depth[static_cast<size_t>(y) * level.w + x] = farthest;
+            }
+    }
+    pyramid.resize(l);
+}
+
+/// The box's screen rectangle and nearest depth bound every triangle of the cluster:
+/// vertices project inside the projected corners, are clamped the same way, and their
+/// depth is truncated. A pixel and a depth unit of margin absorb float rounding.
+bool Renderer::occluded(const Model3D::Bounds &bounds, Camera &camera) const
+{
+    float x0 = std::numeric_limits<float>::infinity(), y0 = x0, x1 = -x0, y1 = -x0, nearest = -x0;
+    for (int i = 0; i < 8; ++i)
+    {
+        vec4f p = {i & 1 ? bounds.max.x : bounds.min.x, i & 2 ? bounds.max.y : bounds.min.y, i & 4 ? bounds.max.z : bounds.min.z, 1.f};
+        p = camera.persp_matrix * (camera.view_matrix * p);
+        if (!(p.w > 1e-6f))
+            return false; // the box reaches behind the eye
+        p = camera.screen_matrix * vec4f{p.x / p.w, p.y / p.w, p.z / p.w, 1.f};
+        x0 = std::min(x0, p.x);
+        y0 = std::min(y0, p.y);
+        x1 = std::max(x1, p.x);
+        y1 = std::max(y1, p.y);
+        nearest = std::max(nearest, p.z);
+    }
+    auto cell = [](float v, int size)
+    { return static_cast<int>(std::clamp(v, 0.f, size - 1.f)) / occlusion_cell; };
+    int cx0 = cell(x0 - 1, width), cy0 = cell(y0 - 1, height);
+    int cx1 = cell(x1 + 1, width), cy1 = cell(y1 + 1, height);
+    // Climb until the rectangle covers at most 8x8 cells.
+    size_t l = 0;
+    for (; l + 1 < pyramid.size() && (cx1 - cx0 > 7 || cy1 - cy0 > 7); ++l)
+    {
+        cx0 /= 2;
+        cy0 /= 2;
+        cx1 /= 2;
+        cy1 /= 2;
+    }
+    const DepthLevel &level = pyramid[l];
+    for (int y = cy0; y <= cy1; ++y)
+        for (int x = cx0; x <= cx1; ++x)
+            if (!(nearest + 1 < level.depth[static_cast<size_t>(y) * level.w + x]))
+                return false;
+    return true;
 }
 
 void Renderer::clear()
 {
 }
 
-void Renderer::triangle(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, TGAImage &image, TGAColor color, Zbuffer &zbuffer, int width, int height)
+namespace
 {
-    int bb_min_x = std::min(std::min(ax, bx), cx);
-    int bb_min_y = std::min(std::min(ay, by), cy);
-    int bb_max_x = std::max(std::max(ax, bx), cx);
-    int bb_max_y = std::max(std::max(ay, by), cy);
-    double triangle_sq = square(ax, ay, bx, by, cx, cy);
+    /// Fragment colors for the raster kernels. `uniform` fragments have one color for the
+    /// whole triangle, so covered pixels can be written as spans.
+    struct FlatFragment
+    {
+        static constexpr bool uniform = true;
+        TGAColor color;
+        TGAColor shade(double, double, double) const { return color; }
+    };
+
+    struct TexturedFragment
+    {
+        static constexpr bool uniform = false;
+        const Texture *texture;
+        float u[3], v[3];
+        float intensity;
+        float lod;
+
+        TGAColor shade(double alpha, double beta, double gamma) const
+        {
+            float tu = static_cast<float>(alpha * u[0] + beta * u[1] + gamma * u[2]);
+            float tv = static_cast<float>(alpha * v[0] + beta * v[1] + gamma * v[2]);
+            TGAColor c = texture->sample(tu, tv, lod);
+            for (int i = 0; i < 3; i++)
+                c.bgra[i] = static_cast<std::uint8_t>(c.bgra[i] * intensity);
+            return c;
+        }
+    };
+
+    /// Barycentric weights are affine in screen space, so the UV derivatives (and the mip
+    /// level) are constant per triangle. `triangle_sq` must be at least 1.
+    TexturedFragment textured_fragment(int ax, int ay, int bx, int by, int cx, int cy, double triangle_sq,
+                                       const vec3f &uva, const vec3f &uvb, const vec3f &uvc, const Texture &texture, float intensity)
+    {
+        double k = 0.5 / triangle_sq;
+        float dudx = static_cast<float>((uva.x * (by - cy) + uvb.x * (cy - ay) + uvc.x * (ay - by)) * k);
+        float dvdx = static_cast<float>((uva.y * (by - cy) + uvb.y * (cy - ay) + uvc.y * (ay - by)) * k);
+        float dudy = static_cast<float>((uva.x * (cx - bx) + uvb.x * (ax - cx) + uvc.x * (bx - ax)) * k);
+        float dvdy = static_cast<float>((uva.y * (cx - bx) + uvb.y * (ax - cx) + uvc.y * (bx - ax)) * k);
+        return {&texture, {uva.x, uvb.x, uvc.x}, {uva.y, uvb.y, uvc.y}, intensity, texture.lod(dudx, dvdx, dudy, dvdy)};
+    }
+}
+
+void Renderer::triangle(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, TGAColor color, Zbuffer &zbuffer, int width, int height)
+{
+    triangle(ax, ay, az, bx, by, bz, cx, cy, cz, target, color, zbuffer, ClipRect{0, 0, width - 1, height - 1});
+}
+
+void Renderer::triangle(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, TGAColor color, Zbuffer &zbuffer, const ClipRect &clip)
+{
+    rasterize(ax, ay, az, bx, by, bz, cx, cy, cz, target, FlatFragment{color}, zbuffer, clip);
+}
+
+void Renderer::triangle_textured(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz,
+                                 const vec3f &uva, const vec3f &uvb, const vec3f &uvc, const Texture &texture, float intensity,
+                                 const Framebuffer &target, Zbuffer &zbuffer, int width, int height)
+{
+    triangle_textured(ax, ay, az, bx, by, bz, cx, cy, cz, uva, uvb, uvc, texture, intensity, target, zbuffer, ClipRect{0, 0, width - 1, height - 1});
+}
 
+void Renderer::triangle_textured(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz,
+                                 const vec3f &uva, const vec3f &uvb, const vec3f &uvc, const Texture &texture, float intensity,
+                                 const Framebuffer &target, Zbuffer &zbuffer, const ClipRect &clip)
+{
+    double triangle_sq = square(ax, ay, bx, by, cx, cy);
     if (triangle_sq < 1)
         return;
+    TexturedFragment fragment = textured_fragment(ax, ay, bx, by, cx, cy, triangle_sq, uva, uvb, uvc, texture, intensity);
+    rasterize(ax, ay, az, bx, by, bz, cx, cy, cz, target, fragment, zbuffer, clip);
+}
+
+void Renderer::raster_packed(const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, size_t first)
+{
+    const size_t pixels = static_cast<size_t>(width) * height;
+    packed.resize(pixels);
+    jobs->parallel_for(0, pixels, 1 << 16, [&](size_t begin, size_t end)
+                       { std::fill(packed.begin() + begin, packed.begin() + end, 0); });
+
+    // No ordering between tasks: the atomic max makes the result independent of it.
+    jobs->parallel_for(first, screen_triangles.size(), 256, [&](size_t begin, size_t end)
+                       {
+                           for (size_t i = begin; i < end; ++i)
+                               draw_packed(i, model); });
+
+    PROFILE_SCOPE("resolve");
+    const int bpp = target.bpp();
+    jobs->parallel_for(0, height, 16, [&](size_t first_row, size_t last_row)
+                       {
+                           for (int y = static_cast<int>(first_row); y < static_cast<int>(last_row); ++y)
+                           {
+                               const std::uint64_t *row = packed.data() + static_cast<size_t>(y) * width;
+                               for (int x = 0; x < width; ++x)
+                               {
+                                   if (!row[x])
+                                       continue;
+                                   double z = key_depth(static_cast<std::uint32_t>(row[x] >> 32));
+                                   size_t i = zbuffer.index(x, y);
+                                   if (zbuffer.data()[i] < z)
+                                   {
+                                       zbuffer.data()[i] = z;
+                                       std::uint32_t color = static_cast<std::uint32_t>(row[x]);
+                                       std::memcpy(target.pixel(x, y), &color, bpp); // little-endian: bytes are B, G, R, A
+                                   }
+                               }
+                           } });
+}
+
+void Renderer::draw_packed(size_t index, const Model3D &model)
+{
+    const ScreenTriangle &t = screen_triangles[index];
+    if (visibility_buffer)
+    {
+        triangle_packed(t.ax, t.ay, t.az, t.bx, t.by, t.bz, t.cx, t.cy, t.cz, FlatFragment{id_color(index)});
+        return;
+    }
+    (this->*bound.draw_packed)(index, model);
+}
 
-    if (bb_max_x < 0 || bb_max_y < 0 || bb_min_x >= width || bb_min_y >= height)
+bool Renderer::cache_reusable(const Model3D &model, const Framebuffer &target) const
+{
+    return cache.valid && cache.age < temporal_refresh && !visibility_buffer &&
+           cache.w == width && cache.h == height && cache.bpp == target.bpp() &&
+           cache.model == &model && cache.texture == texture && cache.shader == bound.draw && cache.lights == lights;
+}
+
+void Renderer::store_frame(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target)
+{
+    PROFILE_SCOPE("temporal");
+    auto inverse = world_to_screen(camera).inverse();
+    cache.valid = inverse.has_value();
+    if (!cache.valid)
         return;
+    cache.from_screen = *inverse;
+    cache.w = width;
+    cache.h = height;
+    cache.bpp = target.bpp();
+    cache.model = &model;
+    cache.texture = texture;
+    cache.shader = bound.draw;
+    cache.lights = lights;
+    cache.age = 0;
+    cache.color.resize(static_cast<size_t>(width) * height * cache.bpp);
+    cache.depth.resize(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            std::memcpy(&cache.color[i * cache.bpp], target.pixel(x, y), cache.bpp);
+            cache.depth[i] = buffer.get(x, y);
+        }
+}
 
-#pragma omp parallel for
-    for (int x = bb_min_x; x <= bb_max_x; x++)
+/// Forward splat: every covered cached pixel goes back to world space through the old camera
+/// and lands on the nearest pixel of the new one. Each landing is a word like the atomic
+/// target's: depth key high, 1 + source pixel low, so the atomic max keeps the nearest
+/// whatever the task order.
+void Renderer::reproject_frame(const Matrix<4, 4, double> &m, const Matrix<4, 4, double> &back, int tiles_x)
+{
+    PROFILE_SCOPE("reproject");
+    const size_t pixels = static_cast<size_t>(width) * height;
+    reprojected.assign(pixels, 0);
+    double col_x[4], col_z[4];
+    for (size_t r = 0; r < 4; ++r)
+        col_x[r] = m[r][0], col_z[r] = m[r][2];
+    // A locked compare-exchange per pixel costs more than the transform, so only tasks use it.
+    auto splat_rows = [&](size_t first_row, size_t last_row, auto atomic)
     {
-        for (int y = bb_min_y; y <= bb_max_y; y++)
+        for (int y = static_cast<int>(first_row); y < static_cast<int>(last_row); ++y)
         {
-            if (x >= 0 && x < width && y >= 0 && y < height)
+            // Step the transform along the row: only x and depth change.
+            double base[4];
+            for (size_t r = 0; r < 4; ++r)
+                base[r] = m[r][1] * y + m[r][3];
+            const double *depth = cache.depth.data() + static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; ++x)
             {
-                auto bary = barycentric(ax, ay, bx, by, cx, cy, x, y);
-
-                double z = static_cast<double>(bary[0] * az + bary[1] * bz + bary[2] * cz);
+                if (depth[x] == -std::numeric_limits<double>::infinity())
+                    continue;
+                const double z = depth[x];
+                const double w = base[3] + col_x[3] * x + col_z[3] * z;
+                if (w <= 1e-6)
+                    continue;
+                const double inv_w = 1 / w;
+                const double sx = (base[0] + col_x[0] * x + col_z[0] * z) * inv_w + 0.5;
+                const double sy = (base[1] + col_x[1] * x + col_z[1] * z) * inv_w + 0.5;
+                if (!(sx >= 0 && sx < width && sy >= 0 && sy < height))
+                    continue;
+                const std::uint64_t key = depth_key((base[2] + col_x[2] * x + col_z[2] * z) * inv_w);
+                const std::uint64_t word = key << 32 | (static_cast<std::uint64_t>(y) * width + x + 1);
+                std::uint64_t &landed = reprojected[static_cast<size_t>(sy) * width + static_cast<size_t>(sx)];
+                if constexpr (atomic)
+                {
+                    std::atomic_ref<std::uint64_t> cell(landed);
+                    std::uint64_t old = cell.load(std::memory_order_relaxed);
+                    while (old < word && !cell.compare_exchange_weak(old, word, std::memory_order_relaxed))
+                    {
+                    }
+                }
+                else if (landed < word)
+                    landed = word;
+            }
+        }
+    };
+    if (jobs && jobs->threads() > 1)
+        jobs->parallel_for(0, height, 16, [&](size_t first_row, size_t last_row)
+                           { splat_rows(first_row, last_row, std::true_type{}); });
+    else
+        splat_rows(0, height, std::false_type{});
 
-                if (bary[0] < 0 || bary[1] < 0 || bary[2] < 0)
+    // Rounding to the pixel grid leaves pinholes and one-pixel cracks even for tiny camera
+    // moves. Fill a hole from the nearer of two opposite neighbours that both landed, unless
+    // it is a gap that was empty in the cache too. Only tiles with triangles are read later;
+    // holes are collected first so fills don't spread.
+    const size_t row = width;
+    hole_fills.clear();
+    for (size_t b = 0; b < bins.size(); ++b)
+    {
+        if (bins[b].empty())
+            continue;
+        const int x0 = static_cast<int>(b % tiles_x) * temporal_tile, y0 = static_cast<int>(b / tiles_x) * temporal_tile;
+        for (int y = std::max(y0, 1); y < std::min(y0 + temporal_tile, height - 1); ++y)
+            for (int x = std::max(x0, 1); x < std::min(x0 + temporal_tile, width - 1); ++x)
+            {
+                const size_t j = static_cast<size_t>(y) * width + x;
+                if (reprojected[j])
                     continue;
+                std::uint64_t word = 0;
+                if (reprojected[j - 1] && reprojected[j + 1])
+                    word = std::max(reprojected[j - 1], reprojected[j + 1]);
+                else if (reprojected[j - row] && reprojected[j + row])
+                    word = std::max(reprojected[j - row], reprojected[j + row]);
+                if (word && !cached_background(back, x, y, key_depth(static_cast<std::uint32_t>(word >> 32))))
+                    hole_fills.push_back({j, word});
+            }
+    }
+    for (auto [hole, word] : hole_fills)
+        reprojected[hole] = word;
+}
+
+template <int BPP>
+void Renderer::copy_reprojected(const Framebuffer &target, Zbuffer &buffer, const ClipRect &clip) const
+{
+    for (int y = clip.y0; y <= clip.y1; ++y)
+        for (int x = clip.x0; x <= clip.x1; ++x)
+        {
+            const std::uint64_t word = reprojected[static_cast<size_t>(y) * width + x];
+            const size_t source = static_cast<std::uint32_t>(word) - 1;
+            std::memcpy(target.pixel(x, y), &cache.color[source * BPP], BPP);
+            const std::uint32_t key = static_cast<std::uint32_t>(word >> 32);
+            buffer.set(x, y, key ? key_depth(key) : -std::numeric_limits<double>::infinity());
+        }
+}
 
-                double prev_z = zbuffer.get(x, y);
+std::uint64_t Renderer::cached_background(const Matrix<4, 4, double> &back, int x, int y, double z) const
+{
+    const double w = back[3][0] * x + back[3][1] * y + back[3][2] * z + back[3][3];
+    if (w <= 1e-6)
+        return 0;
+    const double sx = (back[0][0] * x + back[0][1] * y + back[0][2] * z + back[0][3]) / w + 0.5;
+    const double sy = (back[1][0] * x + back[1][1] * y + back[1][2] * z + back[1][3]) / w + 0.5;
+    if (!(sx >= 0 && sx < width && sy >= 0 && sy < height))
+        return 0;
+    const size_t source = static_cast<size_t>(sy) * width + static_cast<size_t>(sx);
+    return cache.depth[source] == -std::numeric_limits<double>::infinity() ? source + 1 : 0;
+}
 
-                if (prev_z < z)
+void Renderer::render_reprojected(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target)
+{
+    const Matrix<4, 4, double> to_screen = world_to_screen(camera) * cache.from_screen;
+    const auto from_screen = to_screen.inverse();
+    if (!from_screen)
+    {
+        render_frame(model, camera, buffer, target);
+        store_frame(model, camera, buffer, target);
+        return;
+    }
+    transform_faces(model, camera);
+    const int tiles_x = bin_triangles(0, temporal_tile);
+    reproject_frame(to_screen, *from_screen, tiles_x);
+    const int tiles_y = static_cast<int>(bins.size()) / tiles_x;
+
+    std::atomic<size_t> redrawn{0};
+    auto tiles = [&](size_t first_tile, size_t last_tile)
+    {
+        for (size_t b = first_tile; b < last_tile; ++b)
+        {
+            if (bins[b].empty())
+                continue;
+            const int tx = static_cast<int>(b % tiles_x), ty = static_cast<int>(b / tiles_x);
+            const ClipRect clip{tx * temporal_tile, ty * temporal_tile,
+                                std::min((tx + 1) * temporal_tile, width) - 1, std::min((ty + 1) * temporal_tile, height) - 1};
+            // Geometry can slide in from outside the view under border tiles without leaving a hole.
+            bool redraw = tx == 0 || ty == 0 || tx == tiles_x - 1 || ty == tiles_y - 1;
+            std::uint32_t farthest = 0xFFFFFFFFu;
+            bool uncovered = false;
+            for (int y = clip.y0; y <= clip.y1 && !redraw; ++y)
+                for (int x = clip.x0; x <= clip.x1; ++x)
+                    if (std::uint64_t word = reprojected[static_cast<size_t>(y) * width + x])
+                        farthest = std::min(farthest, static_cast<std::uint32_t>(word >> 32));
+                    else
+                        uncovered = true;
+            // Look uncovered pixels up at the farthest depth that landed in the tile: next to
+            // a silhouette that follows the surface's motion instead of the far plane's.
+            const double z = farthest == 0xFFFFFFFFu ? 0 : key_depth(farthest);
+            for (int y = clip.y0; y <= clip.y1 && uncovered && !redraw; ++y)
+                for (int x = clip.x0; x <= clip.x1 && !redraw; ++x)
                 {
-                    zbuffer.set(x, y, z);
-                    image.set(x, y, color);
+                    std::uint64_t &word = reprojected[static_cast<size_t>(y) * width + x];
+                    redraw = !word && !(word = cached_background(*from_screen, x, y, z));
                 }
+            if (redraw)
+            {
+                for (std::uint32_t i : bins[b])
+                    draw(i, model, target, buffer, clip);
+                redrawn.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            switch (cache.bpp)
+            {
+            case TGAImage::GRAYSCALE:
+                copy_reprojected<1>(target, buffer, clip);
+                break;
+            case TGAImage::RGB:
+                copy_reprojected<3>(target, buffer, clip);
+                break;
+            case TGAImage::RGBA:
+                copy_reprojected<4>(target, buffer, clip);
+                break;
             }
         }
+    };
+    {
+        PROFILE_SCOPE("raster");
+        if (jobs && jobs->threads() > 1)
+            jobs->parallel_for(0, bins.size(), 1, tiles);
+        else
+            tiles(0, bins.size());
+    }
+
+    ++cache.age;
+    temporal_stats.reused = true;
+    temporal_stats.tiles = static_cast<size_t>(std::count_if(bins.begin(), bins.end(), [](const auto &bin)
+                                                             { return !bin.empty(); }));
+    temporal_stats.redrawn = redrawn.load();
+    // Keep the occlusion history current so the next full frame can still cull.
+    if (occlusion_culling)
+        update_history(camera, buffer, false);
+    else
+        history_valid = false;
+}
+
+Framebuffer Renderer::clear_ids(TargetLayout layout)
+{
+    if (layout == TargetLayout::Tiled)
+    {
+        ids.assign(static_cast<size_t>(tile_count(width)) * tile_count(height) * tile_size * tile_size, 0);
+        return Framebuffer::tiled(reinterpret_cast<std::uint8_t *>(ids.data()), width, height, sizeof(std::uint32_t));
     }
+    ids.assign(static_cast<size_t>(width) * height, 0);
+    return Framebuffer(reinterpret_cast<std::uint8_t *>(ids.data()), width, height, sizeof(std::uint32_t),
+                       static_cast<std::ptrdiff_t>(width) * sizeof(std::uint32_t));
 }
 
-void Renderer::line(int ax, int ay, int bx, int by, TGAImage &image, TGAColor color)
+void Renderer::shade_ids(const Model3D &model, const Framebuffer &id_target, const Framebuffer &target)
+{
+    PROFILE_SCOPE("shade");
+    auto shade_rows = [&](size_t first, size_t last)
+    {
+        for (int y = static_cast<int>(first); y < static_cast<int>(last); ++y)
+            for (int x = 0, end; x < width; x = end)
+            {
+                std::uint32_t id, next;
+                std::memcpy(&id, id_target.pixel(x, y), sizeof(id));
+                // Neighbouring pixels mostly belong to the same triangle: set it up once per run.
+                for (end = x + 1; end < width; ++end)
+                {
+                    std::memcpy(&next, id_target.pixel(end, y), sizeof(next));
+                    if (next != id)
+                        break;
+                }
+                if (!id)
+                    continue;
+                (this->*bound.shade_span)(~id, model, target, x, end, y);
+            }
+    };
+    if (jobs)
+        jobs->parallel_for(0, height, 16, shade_rows);
+    else
+        shade_rows(0, height);
+}
+
+void Renderer::line(int ax, int ay, int bx, int by, const Framebuffer &target, TGAColor color)
 {
     bool steep = std::abs(ax - bx) < std::abs(ay - by);
     if (steep)
@@ -130,11 +1047,11 @@ void Renderer::line(int ax, int ay, int bx, int by, TGAImage &image, TGAColor co
     {
         if (steep)
         {
-            image.set(y, x, color);
+            target.set(y, x, color);
         }
         else
         {
-            image.set(x, y, color);
+            target.set(x, y, color);
         }
         y += (by - ay) / static_cast<float>(bx - ax);
     }
@@ -145,8 +1062,15 @@ double Renderer::square(int ax, int ay, int bx, int by, int cx, int cy)
     return ((bx - ax) * (cy - ay) - (cx - ax) * (by - ay)) * 0.5;
 }
 
-Zbuffer::Zbuffer(int swidth, int sheight) : width(swidth), height(sheight), depth_map((width * height) + width, -std::numeric_limits<double>::infinity())
+Zbuffer::Zbuffer(int swidth, int sheight, TargetLayout layout) : width(swidth), height(sheight)
 {
+    if (layout == TargetLayout::Tiled)
+    {
+        tiles_x = tile_count(width);
+        depth_map.assign(static_cast<size_t>(tiles_x) * tile_count(height) * tile_size * tile_size, -std::numeric_limits<double>::infinity());
+    }
+    else
+        depth_map.assign((width * height) + width, -std::numeric_limits<double>::infinity());
 }
 
 Zbuffer::~Zbuffer()
@@ -155,20 +1079,11 @@ Zbuffer::~Zbuffer()
 
 void Zbuffer::clear()
 {
+    PROFILE_SCOPE("clear_depth");
     std::fill(depth_map.begin(), depth_map.end(), -std::numeric_limits<float>::infinity());
 }
 
-void Zbuffer::set(int x, int y, double z)
-{
-    depth_map[y * width + x] = z;
-}
-
-double Zbuffer::get(int x, int y)
-{
-    return depth_map[y * width + x];
-}
-
-Camera::Camera(const vec3f &eye, const vec3f &target, const vec3f &up)
+Camera::Camera(const vec3f &eye, const vec3f &target, const vec3f &up, int width, int height) : w(width), h(height), aspect(static_cast<float>(width) / height)
 {
     zax = (eye - target).normalize();
     xax = (up ^ zax).normalize();
@@ -202,6 +1117,13 @@ vec3f Camera::view_persp(const vec3f &point)
     return {p.x, p.y, p.z};
 }
 
+float Camera::clip_w(const vec3f &point)
+{
+    vec4f p = {point.x, point.y, point.z, 1};
+    p = persp_matrix * (view_matrix * p);
+    return p.w;
+}
+
 std::tuple<int, int, int> Camera::screen(const vec3f &point)
 {
     vec4f p = {point.x, point.y, point.z, 1};
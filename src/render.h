@@ -4,31 +4,114 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <stdexcept>
 #include "tgaimage.h"
+#include "framebuffer.h"
 #include "math_core.h"
-#include "SDL3/SDL.h"
 #include "model.h"
+#include "texture.h"
+#include "shader.h"
+#include "profiler.h"
+#include "job_system.h"
 
 class Zbuffer
 {
 public:
-    Zbuffer(int widhth, int height);
+    Zbuffer(int widhth, int height, TargetLayout layout = TargetLayout::Linear);
     ~Zbuffer();
     void clear();
 
-    void set(int x, int y, double z);
+    /// @brief Element index of (x, y) in depth_map for the buffer's layout.
+    size_t index(int x, int y) const
+    {
+        if (tiles_x)
+            return tiled_index(x, y, tiles_x);
+        return static_cast<size_t>(y) * width + x;
+    }
 
-    double get(int x, int y);
+    void set(int x, int y, double z) { depth_map[index(x, y)] = z; }
+
+    double get(int x, int y) const { return depth_map[index(x, y)]; }
+
+    /// @brief Unchecked pointer to the depth values of row `y`. Linear layout only.
+    double *row(int y) { return depth_map.data() + y * width; }
+    double *data() { return depth_map.data(); }
+    /// @brief Number of elements behind data(), including layout padding.
+    size_t size() const { return depth_map.size(); }
+
+    TargetLayout layout() const { return tiles_x ? TargetLayout::Tiled : TargetLayout::Linear; }
 
 private:
     int width, height;
+    int tiles_x = 0; ///< Non-zero for the tiled layout.
     std::vector<double> depth_map;
 };
 
+/// @brief How render_model splits rasterization across a JobSystem.
+enum class RasterStrategy
+{
+    Auto,    ///< Sort-last for many tiny triangles, tiles otherwise.
+    Tiles,   ///< Bin triangles into screen tiles; one task per tile.
+    SortLast, ///< Split the triangle list; one depth and color layer per task, then a depth merge.
+    /// Any task draws any triangle into one buffer of 64-bit depth+color words committed with
+    /// an atomic max. Nearest wins regardless of scheduling, but equal depths keep the larger
+    /// color instead of the first triangle drawn. Screen depths of vertices are whole numbers,
+    /// so such ties are common and about 1-2% of pixels differ from the other paths.
+    Atomic
+};
+
+/// @brief What render_model does to keep hidden fragments from being shaded.
+enum class OverdrawMode
+{
+    None,            ///< Faces in model order.
+    /// Stable sort of the visible triangles by quantized view depth, nearest first, so
+    /// most hidden fragments fail the depth test. Triangles at equal depth can swap
+    /// order, so a handful of tied pixels may differ from the other modes.
+    SortFrontToBack,
+    /// Depth-only pass, then a color pass that shades each pixel only for the first
+    /// triangle whose depth equals the final one. The image is identical to None.
+    DepthPrepass
+};
+
+/// @brief Built-in shader render_model uses when none is given (see shader.h).
+enum class ShadingMode
+{
+    Flat,    ///< One intensity per face, from the face normal.
+    Gouraud, ///< Intensities at the corners, from the vertex normals, interpolated across the face.
+    Phong    ///< Vertex normals interpolated across the face and lit per pixel.
+};
+
+/// @brief Fragment counts of the last render_model call (see Renderer::measure_overdraw).
+struct OverdrawStats
+{
+    std::uint64_t depth_writes = 0; ///< Fragments that passed the depth test and wrote depth.
+    std::uint64_t shaded = 0;       ///< Fragments that wrote a color (or a triangle ID).
+    std::uint64_t covered = 0;      ///< Pixels holding a triangle at the end of the frame.
+
+    /// @brief Shaded fragments per covered pixel; 1 means nothing was shaded twice.
+    double overdraw() const { return covered ? static_cast<double>(shaded) / covered : 0; }
+};
+
+/// @brief Cluster counts of the last render_model call with occlusion culling.
+struct OcclusionStats
+{
+    size_t clusters = 0; ///< Clusters of the model (see Model3D::cluster_size).
+    size_t culled = 0;   ///< Clusters the reprojected history hid in the first pass.
+    size_t late = 0;     ///< Culled clusters the second pass found visible and drew after all.
+};
+
+/// @brief Tile counts of the last render_model call with temporal reuse.
+struct TemporalStats
+{
+    bool reused = false; ///< The frame was reprojected from the last full one.
+    size_t tiles = 0;    ///< Tiles (see Renderer::temporal_tile) that triangles overlap.
+    size_t redrawn = 0;  ///< Of those, tiles rasterized again instead of copied from the reprojection.
+};
+
 struct Camera
 {
     Camera() {};
-    Camera(const vec3f &eye, const vec3f &target, const vec3f &up);
+    Camera(const vec3f &eye, const vec3f &target, const vec3f &up, int width = 800, int height = 800);
     vec3f xax;
     vec3f yax;
     vec3f zax;
@@ -46,6 +129,8 @@ struct Camera
     mat4 ortho_matrix;
 
     vec3f view_persp(const vec3f &point);
+    /// @brief w of `point` after the perspective matrix, before the divide.
+    float clip_w(const vec3f &point);
     std::tuple<int, int, int> screen(const vec3f &point);
 
     ~Camera() {};
@@ -60,18 +145,323 @@ public:
 
     int width;
     int height;
+    /// @brief Diffuse map applied to models that have texture coordinates; nullptr for flat gray.
+    const Texture *texture = nullptr;
+    /// @brief Pool for render_model's transform and raster passes; nullptr (or a 1-thread pool) renders serially.
+    JobSystem *jobs = nullptr;
+    /// @brief How the raster pass is split across `jobs`.
+    /*!
+        The transform pass runs on chunks of faces. With tiles, the triangles are
+        binned into screen tiles of `bin_size` pixels; each tile is rasterized by one
+        task, clipped to the tile, in face order. Every pixel sees the same triangles
+        in the same order as the serial path, so the image is identical.
+
+        When the visible triangles average less than `sort_last_max_area` pixels
+        (dense meshes on small targets), per-tile setup costs more than it saves;
+        `RasterStrategy::Auto` then goes sort-last instead. The triangle list is cut
+        into one contiguous range per thread: the first range is drawn into the
+        target, the others into private layers that are merged back row by row,
+        taking a layer's pixel only if it is strictly nearer. Ties keep the earlier
+        range, which is what the serial depth test does, so the image is identical
+        here too.
+     */
+    RasterStrategy strategy = RasterStrategy::Auto;
+    /// @brief Deferred shading: rasterize depth and triangle IDs only, then shade each pixel once.
+    /*!
+        Whichever strategy runs writes a 32-bit triangle ID per pixel instead of a
+        color. A second pass, split by rows, reads each pixel's ID, recomputes its
+        barycentric weights from the screen triangle exactly as the kernels do and
+        shades it once. The result is the same image; overdraw then costs a depth
+        test and a 4-byte write instead of a texture lookup.
+     */
+    bool visibility_buffer = false;
+    /// @brief Reorder the triangle list or split the raster pass in two before rasterizing.
+    /// The depth pre-pass always uses the tiled split when running on `jobs`.
+    OverdrawMode overdraw_mode = OverdrawMode::None;
+    /// @brief Count fragments during render_model and store them in `overdraw_stats`.
+    bool measure_overdraw = false;
+    OverdrawStats overdraw_stats;
+    /// @brief Skip clusters of faces hidden behind the previous frame's depth.
+    /*!
+        The previous frame's depth, kept as a grid of `occlusion_cell`-pixel cells
+        holding their farthest depth, is reprojected into the new camera and
+        reduced into a pyramid. Clusters whose bounding box is behind every
+        pyramid cell it covers are neither transformed nor rasterized. The
+        reprojection is approximate (disocclusions, holes), so a second pass
+        rebuilds the pyramid from the depth drawn so far, retests the culled
+        clusters against it and draws those that fail. That test only hides
+        geometry behind pixels already drawn this frame, so nothing visible is
+        lost; late clusters come after the others, so depth ties between them can
+        resolve differently. Works with any strategy and overdraw mode; models
+        without `cluster_bounds` are drawn in full.
+     */
+    bool occlusion_culling = false;
+    OcclusionStats occlusion_stats;
+    /// @brief Lighting the shader-less render_model uses; textured models get TexturedShader of it.
+    ShadingMode shading = ShadingMode::Flat;
+    /// @brief Lights of the built-in shaders (ShaderContext::lights for custom ones), at most
+    /// LightLanes::max_lights. Empty lights the model from the camera: a white directional
+    /// light along the view axis.
+    std::vector<Light> lights;
+    /// @brief Reproject the last full frame into up to this many following frames before
+    /// rendering in full again; 0 renders every frame in full.
+    /*!
+        Each full frame's color and depth are kept. The next frames, as long as
+        the size, model, texture, shader and lights stay the same, splat its
+        covered pixels into the new camera (nearest depth wins) and fill one-pixel
+        cracks instead of shading from scratch; the state of a custom shader isn't
+        tracked (see discard_temporal_cache). Triangles are binned into `temporal_tile`
+        tiles; tiles without triangles stay as cleared. In the others, a pixel
+        nothing landed on counts as background if it maps back onto an empty
+        pixel of the kept frame; tiles left with no holes are copied, and the rest
+        (disocclusions, silhouettes that moved, the screen border, where geometry
+        can enter the view) are rasterized as usual. On a still camera the copy is
+        exact. Reused pixels keep the lighting and sampling of the full frame, and
+        a nearer surface can be missed in a copied tile, so the image is
+        approximate. Frames with a visibility buffer are always drawn in full;
+        reprojected frames ignore `overdraw_mode` and draw in face order.
+     */
+    int temporal_refresh = 0;
+    TemporalStats temporal_stats;
 
-    void triangle(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, TGAImage &image, TGAColor color, Zbuffer &zbuffer, int width, int height);
-    void line(int ax, int ay, int bx, int by, TGAImage &image, TGAColor color);
+    void triangle(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, TGAColor color, Zbuffer &zbuffer, int width, int height);
+    /// @brief Textured triangle: UVs are interpolated across the triangle and the mip level is
+    /// chosen from their screen-space derivatives; texels are scaled by `intensity`.
+    void triangle_textured(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz,
+                           const vec3f &uva, const vec3f &uvb, const vec3f &uvc, const Texture &texture, float intensity,
+                           const Framebuffer &target, Zbuffer &zbuffer, int width, int height);
+    void line(int ax, int ay, int bx, int by, const Framebuffer &target, TGAColor color);
     static auto barycentric(int ax, int ay, int bx, int by, int cx, int cy, int px, int py) -> vec3d;
     std::tuple<int, int, int> project(vec3f vert, int width = 800, int height = 800);
-    float light(vec3f v0, vec3f v1, vec3f v2);
 
+    /// @brief Rasterize a model straight into `target` (e.g. a locked SDL texture).
+    /*!
+        Two passes: every face is transformed and back-face culled into a list of
+        screen-space triangles, then the list is rasterized in the original face order
+        and shaded by the shader's vertex, face and fragment stages.
+
+        Pixels are colored by a shader (see shader.h): the one passed to the
+        template overload, or the built-in one `shading` selects, compiled for
+        the smallest of 1, 2, 4 or 8 light lanes that holds `lights`. Shaders
+        light with the normals Model3D computed at load time. There is no model
+        transform: lights are given in model space, so no normal or position
+        is transformed for lighting. Back faces are culled by their winding on
+        screen. Throws std::invalid_argument for more than
+        LightLanes::max_lights lights.
+
+        `jobs`, `strategy`, `visibility_buffer`, `overdraw_mode`,
+        `occlusion_culling` and `temporal_refresh` change how the passes run;
+        see each of them.
+     */
+    void render_model(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target);
     void render_model(const Model3D &model, Camera &camera, Zbuffer &buffer, TGAImage &image);
+    /// @brief render_model with `shader` instead of the built-in one.
+    template <Shader S>
+    void render_model(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target, const S &shader);
     void clear();
+    /// @brief Draw the next frame in full. Temporal reuse notices new lights, shading, models and
+    /// textures by itself, but not a custom shader whose state changed.
+    void discard_temporal_cache() { cache.valid = false; }
+
+    static constexpr int bin_size = 64;
+    static constexpr int sort_last_max_area = 4;
+    static constexpr int occlusion_cell = 8;
+    static constexpr int temporal_tile = 16;
 
 private:
+    /// @brief Inclusive pixel bounds the raster kernels may touch.
+    struct ClipRect
+    {
+        int x0, y0, x1, y1;
+    };
+
+    /// @brief A face after the transform pass, ready to rasterize.
+    struct ScreenTriangle
+    {
+        int ax, ay, az, bx, by, bz, cx, cy, cz;
+        float inv_w[3];     ///< 1 / clip w of the corners; only for shaders with varyings.
+        std::uint32_t face; ///< Index into the model's faces (for UVs and normals).
+    };
+    // Scratch reused across frames.
+    std::vector<ScreenTriangle> screen_triangles;
+    std::vector<std::vector<ScreenTriangle>> chunk_triangles; ///< Per transform task.
+    std::vector<std::vector<std::uint32_t>> bins;              ///< Indices into screen_triangles per screen tile.
+
+    /// @brief Private target of one sort-last range.
+    struct Layer
+    {
+        Zbuffer depth;
+        std::vector<std::uint8_t> pixels;
+        Framebuffer color;
+        ClipRect bounds; ///< Bounding box of the range's triangles; empty if x0 > x1.
+    };
+    std::vector<Layer> layers;
+    std::vector<std::uint64_t> packed; ///< RasterStrategy::Atomic target, row-major; 0 = empty.
+    std::vector<std::uint32_t> ids;    ///< Visibility buffer, in the color target's layout.
+    std::vector<ScreenTriangle> sorted_triangles;
+    std::vector<std::uint32_t> depth_histogram;
+
+    /// @brief Which buffers the raster kernels test and write.
+    enum class DepthPass
+    {
+        Normal,    ///< Depth test, then write depth and color.
+        DepthOnly, ///< Depth test, then write depth.
+        EqualDepth ///< Write color where the depth equals the stored one and `shaded_mask` is clear.
+    };
+    DepthPass depth_pass = DepthPass::Normal;
+    std::vector<std::uint8_t> shaded_mask; ///< Pixels already colored by the EqualDepth pass, in the depth buffer's layout.
+    std::uint64_t depth_writes = 0, shaded_fragments = 0; ///< Updated atomically while measure_overdraw is set.
+
+    /// @brief One level of the occlusion pyramid: the farthest (smallest) depth of each cell, or
+    /// -inf if part of the cell is empty. Level 0 cells are occlusion_cell pixels square.
+    struct DepthLevel
+    {
+        int w = 0, h = 0;
+        std::vector<double> depth;
+    };
+    std::vector<DepthLevel> pyramid;
+    DepthLevel history;                          ///< Level 0 of the previous frame's final depth.
+    Matrix<4, 4, double> history_from_screen;    ///< Previous camera: screen position to world.
+    bool history_valid = false;
+    std::vector<std::uint32_t> visible_clusters, culled_clusters;
+
+    /// @brief The shader of the current render_model call. Each face drawn costs one call
+    /// through these pointers; the pixel loops behind them are compiled for the shader.
+    struct ShaderBinding
+    {
+        const void *shader = nullptr;
+        void (Renderer::*draw)(size_t index, const Model3D &, const Framebuffer &, Zbuffer &, const ClipRect &) = nullptr;
+        void (Renderer::*draw_packed)(size_t index, const Model3D &) = nullptr;
+        /// Shade pixels [x0, x1) of row `y` of the visibility buffer, which all hold triangle `index`.
+        void (Renderer::*shade_span)(size_t index, const Model3D &, const Framebuffer &, int x0, int x1, int y) = nullptr;
+        bool varyings = false; ///< The shader interpolates something, so the transform pass keeps 1 / w.
+    };
+
+    /// @brief The last full frame, kept for temporal reuse. Row-major, `bpp` bytes per pixel.
+    struct TemporalCache
+    {
+        int w = 0, h = 0, bpp = 0;
+        std::vector<std::uint8_t> color;
+        std::vector<double> depth;
+        Matrix<4, 4, double> from_screen; ///< Its camera: screen position to world.
+        const Model3D *model = nullptr;
+        const Texture *texture = nullptr;
+        decltype(ShaderBinding::draw) shader = nullptr; ///< Identifies the shader type.
+        std::vector<Light> lights;                      ///< Renderer::lights it was shaded with.
+        int age = 0; ///< Frames reprojected from it so far.
+        bool valid = false;
+    };
+    TemporalCache cache;
+    /// @brief The cache splatted into the current camera, row-major: depth key << 32 | 1 + cached
+    /// pixel index; 0 where nothing landed, key 0 for pixels found to be background.
+    std::vector<std::uint64_t> reprojected;
+    std::vector<std::pair<size_t, std::uint64_t>> hole_fills; ///< (hole, word it takes) per filled pixel.
+
+    ShaderBinding bound;
+    ShaderContext shader_context;
+    /// @brief Fragment of the DepthPass::DepthOnly pass, which writes no color.
+    struct DepthOnlyFragment;
+    /// @brief Adapts shader S to the raster kernels' fragment interface.
+    template <Shader S>
+    struct ShaderFragment;
+    /// @brief Run the vertex and face stages of the bound S for `t` and pass the fragment to `fn`;
+    /// nothing for faces the kernels would skip.
+    template <Shader S, typename Fn>
+    void with_shader(const ScreenTriangle &t, const Model3D &model, Fn &&fn) const;
+    template <Shader S>
+    void draw_shaded(size_t index, const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, const ClipRect &clip);
+    template <Shader S>
+    void draw_packed_shaded(size_t index, const Model3D &model);
+    template <Shader S>
+    void shade_span(size_t index, const Model3D &model, const Framebuffer &target, int x0, int x1, int y);
+    bool has_texture(const Model3D &model) const;
+    /// @brief The shader-less render_model, with its built-in shader compiled for `Lights` lanes.
+    template <int Lights>
+    void render_lit(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target);
+    /// @brief Everything render_model does, with `bound` set.
+    void render_bound(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target);
+
+    /// @brief Everything render_model does for a frame drawn from scratch.
+    void render_frame(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target);
+    /// @brief A frame built from the reprojected cache plus the tiles it can't cover.
+    void render_reprojected(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target);
+    bool cache_reusable(const Model3D &model, const Framebuffer &target) const;
+    /// @brief Splat the cache into `reprojected`; `m` maps cached to current screen positions, `back` is
+    /// its inverse. `bins` must hold the frame's temporal_tile bins, `tiles_x` per row.
+    void reproject_frame(const Matrix<4, 4, double> &m, const Matrix<4, 4, double> &back, int tiles_x);
+    /// @brief `reprojected` word for (x, y) at depth `z` if that point was empty in the cache, else 0.
+    std::uint64_t cached_background(const Matrix<4, 4, double> &back, int x, int y, double z) const;
+    /// @brief Write the reprojected color and depth of `clip`, which must hold no holes.
+    template <int BPP>
+    void copy_reprojected(const Framebuffer &target, Zbuffer &buffer, const ClipRect &clip) const;
+    void store_frame(const Model3D &model, Camera &camera, Zbuffer &buffer, const Framebuffer &target);
+    /// @brief Bin screen_triangles[first..] into `bins` by square tiles of `tile` pixels; returns tiles per row.
+    int bin_triangles(size_t first, int tile);
+
+    void transform_faces(const Model3D &model, Camera &camera);
+    void transform_range(const Model3D &model, Camera &camera, size_t first, size_t last, std::vector<ScreenTriangle> &out);
+    /// @brief Transform the faces of `clusters`, appending to screen_triangles.
+    void transform_clusters(const Model3D &model, Camera &camera, const std::vector<std::uint32_t> &clusters);
+    /// @brief First pass: test every cluster against the reprojected history and transform the visible ones.
+    void cull_clusters(const Model3D &model, Camera &camera);
+    /// @brief Second pass: retest culled clusters against `zbuffer` and transform those that are visible.
+    void retest_clusters(const Model3D &model, Camera &camera, Zbuffer &zbuffer);
+    void update_history(Camera &camera, Zbuffer &zbuffer, bool pyramid_current);
+    void build_depth_level(Zbuffer &zbuffer, DepthLevel &level);
+    void reproject_history(Camera &camera);
+    void build_pyramid();
+    bool occluded(const Model3D::Bounds &bounds, Camera &camera) const;
+    /// @brief Sort screen_triangles[first..] front to back.
+    void sort_front_to_back(size_t first);
+    /// @brief Rasterize screen_triangles[first..] with the configured strategy; `tiles_only` rules out sort-last and atomic.
+    void raster(const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, size_t first, bool tiles_only);
+    void count_fragments(std::uint64_t depth, std::uint64_t shaded);
+    void raster_binned(const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, size_t first);
+    void raster_sort_last(const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, size_t first);
+    void raster_packed(const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, size_t first);
+    void draw_packed(size_t index, const Model3D &model);
+    /// @brief Rasterize screen_triangles[index]: its color, or its ID with a visibility buffer.
+    void draw(size_t index, const Model3D &model, const Framebuffer &target, Zbuffer &zbuffer, const ClipRect &clip);
+    /// @brief Zero the visibility buffer (resizing it if needed) and return a 4-byte-per-pixel view of it.
+    Framebuffer clear_ids(TargetLayout layout);
+    /// @brief Shade every pixel of `ids` that holds a triangle into `target`.
+    void shade_ids(const Model3D &model, const Framebuffer &ids, const Framebuffer &target);
+    /// @brief Visibility-buffer value of a triangle: bitwise NOT of its index, so 0 means empty
+    /// and, for the atomic strategy, equal depths keep the earliest triangle.
+    static TGAColor id_color(size_t index)
+    {
+        std::uint32_t id = ~static_cast<std::uint32_t>(index);
+        TGAColor c;
+        std::memcpy(c.bgra, &id, sizeof(id));
+        return c;
+    }
+    void triangle(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, TGAColor color, Zbuffer &zbuffer, const ClipRect &clip);
+    void triangle_textured(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz,
+                           const vec3f &uva, const vec3f &uvb, const vec3f &uvc, const Texture &texture, float intensity,
+                           const Framebuffer &target, Zbuffer &zbuffer, const ClipRect &clip);
     static double square(int ax, int ay, int bx, int by, int cx, int cy);
+    /// @brief Words of the atomic target: depth key in the high 32 bits, BGRA in the low 32, so the
+    /// unsigned maximum is the nearest fragment. Keys are fixed point over [-256, 256) (screen depth
+    /// spans 0..255) with 23 fractional bits; key 0 is reserved for empty pixels.
+    static constexpr double depth_key_scale = 8388608.0;
+    static std::uint32_t depth_key(double z)
+    {
+        double key = (z + 256.0) * depth_key_scale;
+        return key < 1 ? 1u : key >= 4294967295.0 ? 0xFFFFFFFFu : static_cast<std::uint32_t>(key);
+    }
+    static double key_depth(std::uint32_t key) { return key / depth_key_scale - 256.0; }
+    template <typename Fragment>
+    void rasterize(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, const Fragment &fragment, Zbuffer &zbuffer, const ClipRect &clip);
+    template <DepthPass Pass, typename Fragment>
+    void rasterize_pass(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, const Fragment &fragment, Zbuffer &zbuffer, const ClipRect &clip);
+    template <DepthPass Pass, int BPP, typename Fragment>
+    void triangle_tiles(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, const Fragment &fragment, Zbuffer &zbuffer, const ClipRect &clip);
+    template <typename Fragment>
+    void triangle_packed(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Fragment &fragment);
+    template <DepthPass Pass, int BPP, typename Fragment>
+    void triangle_spans(int ax, int ay, int az, int bx, int by, int bz, int cx, int cy, int cz, const Framebuffer &target, const Fragment &fragment, Zbuffer &zbuffer, const ClipRect &clip);
 };
 
+#include "raster_kernels.h"
+
 #endif // RENDER_H
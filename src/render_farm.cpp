@@ -0,0 +1,100 @@
+#include "render_farm.h"
+
+#include <algorithm>
+#include <utility>
+
+RenderFarm::RenderFarm(const Model3D &model, int width, int height, int bpp, size_t nthreads, const Texture *texture,
+                       const Setup &setup)
+    : model(model)
+{
+    if (nthreads == 0)
+        nthreads = std::max(1u, std::thread::hardware_concurrency());
+    contexts.reserve(nthreads);
+    for (size_t i = 0; i < nthreads; ++i)
+    {
+        contexts.push_back(std::make_unique<Context>(width, height, bpp));
+        contexts.back()->renderer.texture = texture;
+        if (setup)
+            setup(contexts.back()->renderer);
+    }
+    for (auto &context : contexts)
+        workers.emplace_back(&RenderFarm::worker_loop, this, std::ref(*context));
+}
+
+RenderFarm::~RenderFarm()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (auto &t : workers)
+        t.join();
+}
+
+void RenderFarm::submit(const Camera &camera, FrameCallback on_frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({camera, std::move(on_frame)});
+    }
+    job_ready.notify_one();
+}
+
+void RenderFarm::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]
+              { return jobs.empty() && busy_jobs == 0; });
+    if (error)
+        std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+void RenderFarm::render(const std::vector<Camera> &views, const std::function<void(size_t view, const TGAImage &image)> &on_frame)
+{
+    for (size_t i = 0; i < views.size(); ++i)
+        submit(views[i], [i, &on_frame](const TGAImage &image)
+               { on_frame(i, image); });
+    wait_idle();
+}
+
+void RenderFarm::worker_loop(Context &context)
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_ready.wait(lock, [this]
+                           { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return; // stopping and drained
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            ++busy_jobs;
+        }
+
+        std::exception_ptr failure;
+        try
+        {
+            context.image.clear();
+            context.zbuffer.clear();
+            context.renderer.render_model(model, job.camera, context.zbuffer, context.image);
+            if (job.on_frame)
+                job.on_frame(context.image);
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --busy_jobs;
+            if (failure && !error)
+                error = failure;
+            if (jobs.empty() && busy_jobs == 0)
+                idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,91 @@
+/// @file render_farm.h
+/// @brief Parallel rendering of many independent views of one model.
+/*!
+    Turntables and multi-camera datasets render the same mesh from many cameras.
+    Views don't depend on each other, so each worker thread owns a complete
+    render context (renderer, depth buffer and color target) and takes whole
+    views from a shared job queue. The model and texture are only read and are
+    shared by every worker; nothing is locked while a view is rasterized.
+ */
+#ifndef RENDER_FARM_H
+#define RENDER_FARM_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "render.h"
+
+class RenderFarm
+{
+public:
+    /// @brief Called on the worker thread with the finished view. The image is reused for
+    /// that worker's next view once the callback returns.
+    using FrameCallback = std::function<void(const TGAImage &image)>;
+    /// @brief Sets up one worker's renderer (strategy, shading, ...) before the workers start.
+    using Setup = std::function<void(Renderer &renderer)>;
+
+    /// @param model Mesh shared by all views; must outlive the farm and stay unmodified.
+    /// @param width Width of every view.
+    /// @param height Height of every view.
+    /// @param bpp Bytes per pixel of the color targets (TGAImage::Format).
+    /// @param threads Number of worker threads, 0 for one per hardware thread.
+    /// @param texture Optional diffuse map, shared like the model.
+    /// @param setup Optional, called once for every worker's renderer.
+    RenderFarm(const Model3D &model, int width, int height, int bpp = TGAImage::RGB, size_t threads = 0,
+               const Texture *texture = nullptr, const Setup &setup = {});
+    /// @brief Finishes every submitted view before returning.
+    ~RenderFarm();
+
+    RenderFarm(const RenderFarm &) = delete;
+    RenderFarm &operator=(const RenderFarm &) = delete;
+
+    /// @brief Queue one view; `on_frame` receives the rendered image.
+    void submit(const Camera &camera, FrameCallback on_frame);
+    /// @brief Block until every submitted view has been rendered and delivered.
+    /*!
+        Rethrows the first exception thrown by a render or a callback since the last call.
+     */
+    void wait_idle();
+    /// @brief Render all `views` and wait; `on_frame` gets the index of the view with its image.
+    void render(const std::vector<Camera> &views, const std::function<void(size_t view, const TGAImage &image)> &on_frame);
+
+    size_t threads() const { return workers.size(); }
+
+private:
+    /// @brief Everything one worker writes while rendering a view.
+    struct Context
+    {
+        Context(int width, int height, int bpp) : renderer(width, height), zbuffer(width, height), image(width, height, bpp) {}
+
+        Renderer renderer;
+        Zbuffer zbuffer;
+        TGAImage image;
+    };
+
+    struct Job
+    {
+        Camera camera;
+        FrameCallback on_frame;
+    };
+
+    void worker_loop(Context &context);
+
+    const Model3D &model;
+    std::vector<std::unique_ptr<Context>> contexts;
+    std::deque<Job> jobs;
+    size_t busy_jobs = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable idle;
+    std::vector<std::thread> workers;
+};
+
+#endif // RENDER_FARM_H
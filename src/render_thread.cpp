@@ -0,0 +1,97 @@
+#include "render_thread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+RenderThread::RenderThread(int width, int height, int bpp, std::function<void()> on_frame)
+    : width(width), height(height), bpp(bpp), on_frame(std::move(on_frame)),
+      renderer(width, height), zbuffer(width, height)
+{
+    for (Frame &frame : frames)
+        frame.pixels.assign(static_cast<size_t>(width) * height * bpp, 0);
+    renderer.jobs = &JobSystem::global();
+    worker = std::thread(&RenderThread::loop, this);
+}
+
+RenderThread::~RenderThread()
+{
+    stopping = true;
+    request_count.fetch_add(1, std::memory_order_release);
+    request_count.notify_one();
+    worker.join();
+}
+
+void RenderThread::request(const ViewRequest &view)
+{
+    requests.write_buffer() = view;
+    requests.publish();
+    request_count.fetch_add(1, std::memory_order_release);
+    request_count.notify_one();
+}
+
+void RenderThread::loop()
+{
+    std::uint64_t seen = 0;
+    float shown = 1.f;
+    for (;;)
+    {
+        // Sleep until a new request, unless the last frame still needs refining.
+        if (shown >= 1.f)
+            request_count.wait(seen, std::memory_order_acquire);
+        if (stopping)
+            return;
+        seen = request_count.load(std::memory_order_acquire);
+
+        bool fresh = requests.update();
+        const ViewRequest &view = requests.read_buffer();
+        if (!view.model || (!fresh && shown >= 1.f))
+            continue;
+
+        float scale = !fresh ? ResolutionScale::refine(shown) : view.interacting ? scaler.interactive() : 1.f;
+        try
+        {
+            render(view, scale);
+            shown = scale;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "render failed: " << e.what() << "\n";
+            shown = 1.f;
+        }
+    }
+}
+
+void RenderThread::render(const ViewRequest &view, float scale)
+{
+    int w = std::max(1, static_cast<int>(width * scale + 0.5f));
+    int h = std::max(1, static_cast<int>(height * scale + 0.5f));
+
+    // `ready` only changes on this thread, so the other frame is ours to write.
+    Frame &frame = frames[1 - ready];
+    Framebuffer target(frame.pixels.data(), w, h, bpp, static_cast<std::ptrdiff_t>(w) * bpp, true);
+    Camera camera(view.eye, view.target, view.up, w, h);
+
+    auto start = std::chrono::steady_clock::now();
+    target.clear();
+    zbuffer.clear();
+    renderer.width = w;
+    renderer.height = h;
+    renderer.texture = view.texture.get();
+    renderer.temporal_refresh = view.interacting ? view.temporal_refresh : 0;
+    renderer.render_model(*view.model, camera, zbuffer, target);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    scaler.record(scale, ms);
+
+    frame.width = w;
+    frame.height = h;
+    frame.scale = scale;
+    frame.render_ms = ms;
+    {
+        std::lock_guard<std::mutex> lock(swap_mutex);
+        ready = 1 - ready;
+        frame_fresh = true;
+    }
+    if (on_frame)
+        on_frame();
+}
@@ -0,0 +1,111 @@
+/// @file render_thread.h
+/// @brief Viewport rendering on a dedicated thread.
+/*!
+    The UI thread describes what to draw in a `ViewRequest` and hands it over
+    through a lock-free TripleBuffer; it never waits for the rasterizer. The
+    render thread always renders the newest request into one of two frames
+    while the UI thread may be uploading the other, so in steady state a frame
+    costs max(render, present) instead of their sum. The ready frame is swapped
+    under a mutex that is only held for the swap and for the upload.
+
+    The thread also owns dynamic resolution: interactive requests render at the
+    scale a ResolutionScale picks for the frame budget, and when no new request
+    arrives it refines the last view back to full resolution on its own. Each
+    frame is split across the global JobSystem. Requests can also ask for
+    temporal reuse while interacting; frames that settle are always drawn in full.
+ */
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "render.h"
+#include "resolution_scale.h"
+#include "triple_buffer.h"
+
+/// @brief Everything the render thread needs to draw one view.
+struct ViewRequest
+{
+    std::shared_ptr<const Model3D> model; ///< Nothing is drawn while null.
+    std::shared_ptr<const Texture> texture;
+    vec3f eye;
+    vec3f target;
+    vec3f up;
+    bool interacting = false; ///< Camera is being dragged: render at reduced resolution if needed.
+    /// While interacting, reproject each full frame into up to this many following ones
+    /// (Renderer::temporal_refresh); 0 draws every frame in full.
+    int temporal_refresh = 0;
+};
+
+class RenderThread
+{
+public:
+    /// @brief A finished frame: `width` x `height` pixels, rows top-down and tightly packed.
+    struct Frame
+    {
+        std::vector<std::uint8_t> pixels;
+        int width = 0;
+        int height = 0;
+        float scale = 1.f;
+        double render_ms = 0;
+    };
+
+    /// @param width Full-resolution width.
+    /// @param height Full-resolution height.
+    /// @param bpp Bytes per pixel of the frames (TGAImage::Format).
+    /// @param on_frame Called on the render thread after a frame becomes ready (e.g. to wake
+    ///                 the UI event loop). Must not call back into the RenderThread.
+    RenderThread(int width, int height, int bpp, std::function<void()> on_frame = {});
+    ~RenderThread();
+
+    RenderThread(const RenderThread &) = delete;
+    RenderThread &operator=(const RenderThread &) = delete;
+
+    /// @brief UI thread: replace the view to render. Never blocks.
+    void request(const ViewRequest &view);
+
+    /// @brief UI thread: if a frame finished since the last call, pass it to `fn` and return true.
+    /*!
+        The render thread can't swap frames while `fn` runs, so keep it short (an upload).
+     */
+    template <typename Fn>
+    bool consume(Fn &&fn)
+    {
+        std::lock_guard<std::mutex> lock(swap_mutex);
+        if (!frame_fresh)
+            return false;
+        frame_fresh = false;
+        fn(static_cast<const Frame &>(frames[ready]));
+        return true;
+    }
+
+private:
+    void loop();
+    void render(const ViewRequest &view, float scale);
+
+    const int width, height, bpp;
+    std::function<void()> on_frame;
+
+    TripleBuffer<ViewRequest> requests;
+    std::atomic<std::uint64_t> request_count{0};
+    std::atomic<bool> stopping{false};
+
+    // Render thread only.
+    Renderer renderer;
+    Zbuffer zbuffer;
+    ResolutionScale scaler;
+
+    Frame frames[2];
+    int ready = 0; ///< Frame the UI thread may read; written by the render thread under swap_mutex.
+    bool frame_fresh = false;
+    std::mutex swap_mutex;
+
+    std::thread worker;
+};
+
+#endif // RENDER_THREAD_H
@@ -0,0 +1,58 @@
+/// @file resolution_scale.h
+/// @brief Frame-time controller for dynamic resolution in the viewport.
+/*!
+    While the camera is being dragged the viewport renders at `scale` times the
+    full width and height and lets SDL stretch the result. Render time is
+    modelled as proportional to the pixel count, so every measured frame gives
+    an estimate of the full-resolution cost (`ms / scale^2`). The estimate is
+    smoothed, and the next scale is the one that fits the target frame time.
+
+    Once input stops, `refine()` steps back up to full resolution in a few
+    frames that each double the pixel count, so the sharp image arrives soon
+    without one long stall right after the user lets go.
+ */
+#ifndef RESOLUTION_SCALE_H
+#define RESOLUTION_SCALE_H
+
+#include <algorithm>
+#include <cmath>
+
+class ResolutionScale
+{
+public:
+    /// @param target_ms Render time budget per interactive frame.
+    /// @param min_scale Lower bound of the scale, per axis.
+    explicit ResolutionScale(double target_ms = 12.0, float min_scale = 0.25f)
+        : target(target_ms), lowest(min_scale)
+    {
+    }
+
+    /// @brief Scale (per axis, in [min_scale, 1]) for the next interactive frame.
+    float interactive() const { return current; }
+
+    /// @brief Feed the measured render time of a frame rendered at `scale`.
+    void record(float scale, double ms)
+    {
+        double full_ms = ms / (static_cast<double>(scale) * scale);
+        estimate = estimate > 0 ? estimate + smoothing * (full_ms - estimate) : full_ms;
+        float fit = static_cast<float>(std::sqrt(target / estimate));
+        // Snap to 1/32 steps so tiny fluctuations don't change the size every frame.
+        current = std::clamp(std::floor(fit * 32.f) / 32.f, lowest, 1.f);
+    }
+
+    /// @brief Next refinement step after a frame at `scale`; returns 1 once at full resolution.
+    static float refine(float scale)
+    {
+        return std::min(1.f, scale * 1.41421356f);
+    }
+
+private:
+    static constexpr double smoothing = 0.3;
+
+    double target;
+    float lowest;
+    float current = 1.f;
+    double estimate = 0; ///< Smoothed full-resolution render time, 0 until the first frame.
+};
+
+#endif // RESOLUTION_SCALE_H
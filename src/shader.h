@@ -0,0 +1,376 @@
+/// @file shader.h
+/// @brief Compile-time shaders for Renderer::render_model.
+/*!
+    A shader is a plain type with a vertex, a face and a fragment stage. It is
+    passed to `Renderer::render_model` as a template argument, and the raster
+    kernels are instantiated for it, so every stage can be inlined into the
+    pixel loops: there is no virtual or `std::function` call per pixel, only
+    one indirect call per face drawn.
+
+        static constexpr int varyings;   // floats each corner passes on
+        struct Face { ... };             // constants of one face, may be empty
+
+        Varyings<varyings> vertex(const ShaderContext &, const ShaderFace &, int corner) const;
+        Face face(const ShaderContext &, const ShaderFace &, const Varyings<varyings> (&corners)[3]) const;
+        TGAColor fragment(const Face &, const Varyings<varyings> &) const;
+
+    `vertex` runs for the three corners of a face that survived culling,
+    `face` once per face with the corners' outputs, and `fragment` for each
+    pixel that passes the depth test, with the varyings interpolated
+    perspective-correctly. Varyings are a fixed-size array, so interpolation
+    unrolls to exactly the floats a shader declares. A shader with none has
+    one color per face: it is computed once and the kernels fill it in spans,
+    as for the flat gray the renderer started with.
+
+    The built-in shaders implement ShadingMode, untextured and textured, for
+    the lights in `ShaderContext::lights`. Each is a template on the number of
+    light lanes it evaluates, so the light loop has a fixed trip count.
+ */
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include "math_core.h"
+#include "model.h"
+#include "texture.h"
+#include "tgaimage.h"
+
+/// @brief Per-corner outputs of a vertex stage, interpolated for the fragment stage.
+template <int N>
+using Varyings = std::array<float, N>;
+
+enum class LightType
+{
+    Directional, ///< Parallel rays along `direction`, no falloff.
+    Point,       ///< From `position` in all directions.
+    Spot         ///< From `position`, in a cone around `direction`.
+};
+
+/// @brief A light source, in model space (see Renderer::lights).
+struct Light
+{
+    LightType type = LightType::Directional;
+    vec3f direction{0, 0, -1}; ///< Directional and spot: the way the light travels.
+    vec3f position{0, 0, 0};   ///< Point and spot.
+    vec3f color{1, 1, 1};      ///< Red, green, blue in x, y, z.
+    float intensity = 1;
+    /// Point and spot: distance at which the light has fallen to half, as 1 / (1 + (d / radius)^2).
+    float radius = 1;
+    /// Spot: half-angles in radians of the fully lit cone and of the cone's edge.
+    float inner_angle = 0.3f, outer_angle = 0.5f;
+
+    bool operator==(const Light &) const = default;
+};
+
+/// @brief Up to max_lights lights in structure-of-arrays form, one lane per light.
+/*!
+    Every kind of light goes through the same branch-free formula, so shading
+    loops over a fixed number of lanes and the compiler can evaluate several
+    lights per SIMD instruction, and a handful of lights costs little more than
+    one. Directional lanes have `positional` 0 and hold the unit
+    vector toward the light in `x, y, z`; the others have 1 and hold their
+    position. Lanes other than spots get a cone that passes everything, unused
+    lanes a zero color.
+ */
+struct LightLanes
+{
+    static constexpr int max_lights = 8;
+
+    alignas(32) float x[max_lights], y[max_lights], z[max_lights];
+    alignas(32) float positional[max_lights];
+    alignas(32) float inv_radius2[max_lights];
+    alignas(32) float axis_x[max_lights], axis_y[max_lights], axis_z[max_lights]; ///< Spot direction; 0 for others.
+    alignas(32) float cos_outer[max_lights], cone_scale[max_lights];
+    alignas(32) float r[max_lights], g[max_lights], b[max_lights]; ///< Color times intensity.
+    bool any_positional = false; ///< Some lane is a point or spot light.
+
+    /// @brief Fill the lanes from `lights[0..n)`; n must be at most max_lights.
+    void set(const Light *lights, int n)
+    {
+        any_positional = false;
+        for (int i = 0; i < max_lights; ++i)
+        {
+            x[i] = y[i] = 0;
+            z[i] = 1;
+            positional[i] = inv_radius2[i] = 0;
+            axis_x[i] = axis_y[i] = axis_z[i] = 0;
+            cos_outer[i] = -1;
+            cone_scale[i] = 1;
+            r[i] = g[i] = b[i] = 0;
+            if (i >= n)
+                continue;
+            const Light &light = lights[i];
+            if (light.type == LightType::Directional)
+            {
+                vec3f to_light = light.direction;
+                to_light.normalize(-1.f);
+                x[i] = to_light.x;
+                y[i] = to_light.y;
+                z[i] = to_light.z;
+            }
+            else
+            {
+                x[i] = light.position.x;
+                y[i] = light.position.y;
+                z[i] = light.position.z;
+                positional[i] = 1;
+                inv_radius2[i] = 1 / (light.radius * light.radius);
+                any_positional = true;
+            }
+            if (light.type == LightType::Spot)
+            {
+                vec3f axis = light.direction;
+                axis.normalize();
+                axis_x[i] = axis.x;
+                axis_y[i] = axis.y;
+                axis_z[i] = axis.z;
+                float inner = std::cos(light.inner_angle);
+                cos_outer[i] = std::cos(light.outer_angle);
+                cone_scale[i] = inner > cos_outer[i] ? 1 / (inner - cos_outer[i]) : 1e6f;
+            }
+            r[i] = light.color.x * light.intensity;
+            g[i] = light.color.y * light.intensity;
+            b[i] = light.color.z * light.intensity;
+        }
+    }
+
+    /// @brief Diffuse light per channel at point `p` with unit normal `n`, summed over the first N lanes.
+    /*!
+        With `Positional` false the lanes must all be directional (see `any_positional`)
+        and the position terms are compiled out. Per-pixel shaders should pick it at
+        compile time: a branch on `any_positional` in a pixel loop costs about as much as
+        the terms it skips.
+     */
+    template <int N, bool Positional>
+    vec3f shade(const vec3f &n, const vec3f &p) const
+    {
+        static_assert(N >= 1 && N <= max_lights && (N & (N - 1)) == 0);
+        // No branches or cross-lane dependences in the loop body, so it maps onto SIMD lanes
+        // without fast-math flags: the clamps below are arithmetic and the sum is a separate step.
+        const float px = p.x, py = p.y, pz = p.z, nx = n.x, ny = n.y, nz = n.z;
+        alignas(32) float lr[N], lg[N], lb[N];
+        for (int i = 0; i < N; ++i)
+        {
+            float lx = x[i], ly = y[i], lz = z[i];
+            float attenuation = 1;
+            if constexpr (Positional)
+            {
+                lx -= positional[i] * px;
+                ly -= positional[i] * py;
+                lz -= positional[i] * pz;
+                // The bias keeps a light at the point itself finite and vanishes against directional lanes' 1.
+                float d2 = lx * lx + ly * ly + lz * lz + 1e-12f;
+                // Normalizes positional lanes; exactly 1 for directional ones, which are unit already.
+                float scale = 1 + positional[i] * (1 / std::sqrt(d2) - 1);
+                lx *= scale;
+                ly *= scale;
+                lz *= scale;
+                float cone = (-(axis_x[i] * lx + axis_y[i] * ly + axis_z[i] * lz) - cos_outer[i]) * cone_scale[i];
+                cone = (std::abs(cone) - std::abs(cone - 1) + 1) * 0.5f; // clamp(cone, 0, 1)
+                attenuation = cone / (1 + positional[i] * d2 * inv_radius2[i]);
+            }
+            float lambert = nx * lx + ny * ly + nz * lz;
+            lambert = (lambert + std::abs(lambert)) * 0.5f; // max(0, lambert)
+            float w = lambert * attenuation;
+            lr[i] = w * r[i];
+            lg[i] = w * g[i];
+            lb[i] = w * b[i];
+        }
+        // Pairwise, so the order of the adds is fixed and each step is lane-parallel.
+        for (int half = N / 2; half > 0; half /= 2)
+            for (int i = 0; i < half; ++i)
+            {
+                lr[i] += lr[i + half];
+                lg[i] += lg[i + half];
+                lb[i] += lb[i + half];
+            }
+        return {lr[0], lg[0], lb[0]};
+    }
+};
+
+/// @brief Frame-wide inputs of every stage.
+struct ShaderContext
+{
+    LightLanes lights;
+    const Texture *texture = nullptr; ///< Renderer::texture if the model has texture coordinates, else null.
+};
+
+/// @brief The face being drawn.
+struct ShaderFace
+{
+    const Model3D &model;
+    std::uint32_t index; ///< Into the model's per-face arrays (render_obj, render_uv, face_normals, ...).
+    int x[3], y[3];      ///< Screen positions of the corners.
+    double area;         ///< Screen area in pixels; at least 1, smaller faces aren't drawn.
+};
+
+template <typename S>
+concept Shader = requires(const S &shader, const ShaderContext &context, const ShaderFace &face,
+                          const Varyings<S::varyings> (&corners)[3], const typename S::Face &constants,
+                          const Varyings<S::varyings> &varyings) {
+    { shader.vertex(context, face, 0) } -> std::same_as<Varyings<S::varyings>>;
+    { shader.face(context, face, corners) } -> std::same_as<typename S::Face>;
+    { shader.fragment(constants, varyings) } -> std::same_as<TGAColor>;
+};
+
+/// @brief Light per channel to an opaque color, saturating at 1.
+inline TGAColor lit_color(const vec3f &light)
+{
+    auto channel = [](float v)
+    { return static_cast<std::uint8_t>(std::min(v, 1.f) * 255); };
+    return {{channel(light.z), channel(light.y), channel(light.x), 255}};
+}
+
+/// @brief LightLanes::shade with `Positional` picked at run time, for per-face and per-vertex stages.
+template <int Lights>
+vec3f shade_lights(const LightLanes &lights, const vec3f &n, const vec3f &p)
+{
+    return lights.any_positional ? lights.shade<Lights, true>(n, p) : lights.shade<Lights, false>(n, p);
+}
+
+/// @brief ShadingMode::Flat: the face normal, lit once per face at its centroid.
+template <int Lights>
+struct FlatShader
+{
+    static constexpr int varyings = 0;
+    struct Face
+    {
+        vec3f light;
+    };
+
+    Varyings<0> vertex(const ShaderContext &, const ShaderFace &, int) const { return {}; }
+    Face face(const ShaderContext &context, const ShaderFace &face, const Varyings<0> (&)[3]) const
+    {
+        const auto &corners = face.model.render_obj[face.index];
+        vec3f centroid = (corners[0] + corners[1] + corners[2]) / 3.f;
+        return {shade_lights<Lights>(context.lights, face.model.face_normals[face.index].unpack(), centroid)};
+    }
+    vec3f light(const Face &face, const Varyings<0> &) const { return face.light; }
+    TGAColor fragment(const Face &face, const Varyings<0> &v) const { return lit_color(light(face, v)); }
+};
+
+/// @brief ShadingMode::Gouraud: the vertex normals lit at the corners, the light interpolated.
+template <int Lights>
+struct GouraudShader
+{
+    static constexpr int varyings = 3;
+    struct Face
+    {
+    };
+
+    Varyings<3> vertex(const ShaderContext &context, const ShaderFace &face, int corner) const
+    {
+        const Model3D &m = face.model;
+        vec3f light = shade_lights<Lights>(context.lights, m.vertex_normals[m.face_vertices[face.index][corner]].unpack(),
+                                           m.render_obj[face.index][corner]);
+        return {light.x, light.y, light.z};
+    }
+    Face face(const ShaderContext &, const ShaderFace &, const Varyings<3> (&)[3]) const { return {}; }
+    vec3f light(const Face &, const Varyings<3> &v) const { return {v[0], v[1], v[2]}; }
+    TGAColor fragment(const Face &face, const Varyings<3> &v) const { return lit_color(light(face, v)); }
+};
+
+/// @brief ShadingMode::Phong: the vertex normals, and positions for point and spot lights,
+/// interpolated and lit per pixel. `Positional` must be true if any light is a point or spot light.
+template <int Lights, bool Positional>
+struct PhongShader
+{
+    static constexpr int varyings = Positional ? 6 : 3;
+    struct Face
+    {
+        const LightLanes *lights;
+    };
+
+    Varyings<varyings> vertex(const ShaderContext &, const ShaderFace &face, int corner) const
+    {
+        const Model3D &m = face.model;
+        vec3f n = m.vertex_normals[m.face_vertices[face.index][corner]].unpack();
+        if constexpr (Positional)
+        {
+            const vec3f &p = m.render_obj[face.index][corner];
+            return {n.x, n.y, n.z, p.x, p.y, p.z};
+        }
+        else
+            return {n.x, n.y, n.z};
+    }
+    Face face(const ShaderContext &context, const ShaderFace &, const Varyings<varyings> (&)[3]) const { return {&context.lights}; }
+    vec3f light(const Face &face, const Varyings<varyings> &v) const
+    {
+        float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (!(len > 0))
+            return {0, 0, 0};
+        float k = 1 / len;
+        vec3f p{0, 0, 0};
+        if constexpr (Positional)
+            p = {v[3], v[4], v[5]};
+        return face.lights->template shade<Lights, Positional>({v[0] * k, v[1] * k, v[2] * k}, p);
+    }
+    TGAColor fragment(const Face &face, const Varyings<varyings> &v) const { return lit_color(light(face, v)); }
+};
+
+/// @brief Diffuse map times the light of one of the shaders above.
+/*!
+    Varyings 0 and 1 are the texture coordinates, the lighting's follow. The mip
+    level comes from the screen-space UV derivatives, taken as constant over the face.
+ */
+template <typename Lighting>
+struct TexturedShader
+{
+    static constexpr int lit = Lighting::varyings;
+    static constexpr int varyings = 2 + lit;
+    struct Face
+    {
+        typename Lighting::Face light;
+        const Texture *texture;
+        float lod;
+    };
+
+    Lighting lighting;
+
+    Varyings<varyings> vertex(const ShaderContext &context, const ShaderFace &face, int corner) const
+    {
+        const vec3f &uv = face.model.render_uv[face.index][corner];
+        Varyings<lit> light = lighting.vertex(context, face, corner);
+        Varyings<varyings> out;
+        out[0] = uv.x;
+        out[1] = uv.y;
+        if constexpr (lit > 0)
+            std::copy(light.begin(), light.end(), out.begin() + 2);
+        return out;
+    }
+
+    Face face(const ShaderContext &context, const ShaderFace &face, const Varyings<varyings> (&corners)[3]) const
+    {
+        Varyings<lit> light[3];
+        if constexpr (lit > 0)
+            for (int k = 0; k < 3; ++k)
+                std::copy(corners[k].begin() + 2, corners[k].end(), light[k].begin());
+        const int *x = face.x, *y = face.y;
+        const Varyings<varyings> &a = corners[0], &b = corners[1], &c = corners[2];
+        double k = 0.5 / face.area;
+        float dudx = static_cast<float>((a[0] * (y[1] - y[2]) + b[0] * (y[2] - y[0]) + c[0] * (y[0] - y[1])) * k);
+        float dvdx = static_cast<float>((a[1] * (y[1] - y[2]) + b[1] * (y[2] - y[0]) + c[1] * (y[0] - y[1])) * k);
+        float dudy = static_cast<float>((a[0] * (x[2] - x[1]) + b[0] * (x[0] - x[2]) + c[0] * (x[1] - x[0])) * k);
+        float dvdy = static_cast<float>((a[1] * (x[2] - x[1]) + b[1] * (x[0] - x[2]) + c[1] * (x[1] - x[0])) * k);
+        return {lighting.face(context, face, light), context.texture, context.texture->lod(dudx, dvdx, dudy, dvdy)};
+    }
+
+    TGAColor fragment(const Face &face, const Varyings<varyings> &v) const
+    {
+        Varyings<lit> light;
+        if constexpr (lit > 0)
+            std::copy(v.begin() + 2, v.end(), light.begin());
+        vec3f l = lighting.light(face.light, light);
+        TGAColor c = face.texture->sample(v[0], v[1], face.lod);
+        const float scale[3] = {l.z, l.y, l.x}; // BGRA
+        for (int i = 0; i < 3; i++)
+            c.bgra[i] = static_cast<std::uint8_t>(std::min(c.bgra[i] * scale[i], 255.f));
+        return c;
+    }
+};
+
+#endif // SHADER_H
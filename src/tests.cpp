@@ -1,7 +1,10 @@
 #include <iostream>
 #include <cmath>
 #include <array>
+#include <atomic>
+#include <stdexcept>
 #include "math_core.h"
+#include "job_system.h"
 
 using namespace std;
 
@@ -68,6 +71,10 @@ int main()
     cout << "m3a * 3:\n";
     printMatrix(m3_scalar);
     cout << "det(m3a) = " << m3a.det() << "\n\n";
+    cout << "inverse(m3a):\n";
+    printMatrix(*m3a.inverse());
+    cout << "m3a * inverse(m3a):\n";
+    printMatrix(m3a * *m3a.inverse());
 
     // 4x4
     cout << "   MATRIX 4x4 TESTS   \n";
@@ -138,6 +145,40 @@ int main()
     printMatrix(m4b);
     cout << "mult vec: " << vector1.x << ", " << vector1.y << ", " << vector1.z << ", " << vector1.w << "\n";
 
+    // JOB SYSTEM
+    cout << "\n    JOB SYSTEM TESTS     \n";
+    JobSystem jobs(4);
+
+    TaskGroup first, second;
+    int stage = 0;
+    jobs.run(first, [&]
+             { stage = 1; });
+    jobs.then(first, second, [&]
+              { stage = stage == 1 ? 2 : -1; });
+    jobs.wait(second);
+    cout << "then() runs after its group: " << (stage == 2 ? "yes" : "NO") << "\n";
+
+    TaskGroup failing;
+    jobs.run(failing, []
+             { throw runtime_error("task failed"); });
+    try
+    {
+        jobs.wait(failing);
+        cout << "wait() rethrows: NO\n";
+    }
+    catch (const runtime_error &e)
+    {
+        cout << "wait() rethrows: yes (" << e.what() << ")\n";
+    }
+
+    atomic<int> covered{0};
+    jobs.parallel_for(0, 16, 1, [&](size_t begin, size_t end)
+                      {
+        for (size_t i = begin; i < end; ++i)
+            jobs.parallel_for(0, 100, 10, [&](size_t b, size_t e)
+                              { covered += static_cast<int>(e - b); }); });
+    cout << "nested parallel_for covered " << covered << " of 1600 indices\n\n";
+
     cout << "Press Enter to exit...";
     cin.ignore();
     cin.get();
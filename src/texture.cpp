@@ -0,0 +1,75 @@
+#include "texture.h"
+
+#include <algorithm>
+#include "imagecodec.h"
+
+bool Texture::load(const std::string &filename)
+{
+    TGAImage image;
+    if (!read_image(image, filename))
+        return false;
+    assign(image);
+    return true;
+}
+
+void Texture::assign(const TGAImage &image)
+{
+    mips.clear();
+    if (!image.width() || !image.height())
+        return;
+
+    // Level 0 in a linear scratch buffer; each level is reduced from the previous one.
+    int w = image.width(), h = image.height();
+    std::vector<std::uint32_t> linear(static_cast<size_t>(w) * h);
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x)
+        {
+            TGAColor c = image.get(x, y);
+            if (image.get_bpp() == TGAImage::GRAYSCALE)
+                c.bgra[1] = c.bgra[2] = c.bgra[0];
+            if (image.get_bpp() != TGAImage::RGBA)
+                c.bgra[3] = 255;
+            linear[static_cast<size_t>(y) * w + x] = c.bgra[0] | (c.bgra[1] << 8) | (c.bgra[2] << 16) | (std::uint32_t(c.bgra[3]) << 24);
+        }
+
+    for (;;)
+    {
+        Level level;
+        level.w = w;
+        level.h = h;
+        level.blocks_x = (w + block - 1) / block;
+        level.texels.assign(static_cast<size_t>(level.blocks_x) * ((h + block - 1) / block) * block * block, 0);
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+                level.texels[level.index(x, y)] = linear[static_cast<size_t>(y) * w + x];
+        mips.push_back(std::move(level));
+
+        if (w == 1 && h == 1)
+            break;
+
+        // 2x2 box filter. An odd last row/column is dropped; a side of 1 texel is
+        // clamped so its texels are averaged with themselves.
+        int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        std::vector<std::uint32_t> next(static_cast<size_t>(nw) * nh);
+        for (int y = 0; y < nh; ++y)
+            for (int x = 0; x < nw; ++x)
+            {
+                int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+                int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+                std::uint32_t t[4] = {linear[static_cast<size_t>(y0) * w + x0], linear[static_cast<size_t>(y0) * w + x1],
+                                      linear[static_cast<size_t>(y1) * w + x0], linear[static_cast<size_t>(y1) * w + x1]};
+                std::uint32_t out = 0;
+                for (int c = 0; c < 32; c += 8)
+                {
+                    std::uint32_t sum = 2; // round to nearest
+                    for (std::uint32_t v : t)
+                        sum += (v >> c) & 0xff;
+                    out |= (sum / 4) << c;
+                }
+                next[static_cast<size_t>(y) * nw + x] = out;
+            }
+        linear = std::move(next);
+        w = nw;
+        h = nh;
+    }
+}
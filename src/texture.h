@@ -0,0 +1,91 @@
+/// @file texture.h
+/// @brief Mipmapped textures for the rasterizer.
+/*!
+    A `Texture` is loaded through `read_image` (TGA, QOI or PNG), expanded to
+    BGRA and turned into a box-filtered mip chain at load time. Every level is
+    stored in 4x4 texel blocks: one block is 64 bytes, a single cache line, so
+    the texels a triangle samples from a small screen area share a few lines
+    instead of one line per texture row.
+
+    The rasterizer picks the level from the screen-space UV derivatives of each
+    triangle (see `lod()`), so distant, minified geometry reads small levels
+    that stay resident in cache and does not alias.
+ */
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tgaimage.h"
+
+class Texture
+{
+public:
+    Texture() = default;
+    /// @brief Load an image and build its mip chain.
+    /// @return False if the file can't be read.
+    bool load(const std::string &filename);
+    /// @brief Build the mip chain from an image already in memory (row 0 = top).
+    void assign(const TGAImage &image);
+
+    bool empty() const { return mips.empty(); }
+    int levels() const { return static_cast<int>(mips.size()); }
+    int width(int level = 0) const { return mips[level].w; }
+    int height(int level = 0) const { return mips[level].h; }
+
+    /// @brief Mip level for the given UV derivatives per screen pixel.
+    /*!
+        lod = log2(max(|d(uv)/dx|, |d(uv)/dy|)), with the derivatives measured in texels of level 0.
+     */
+    float lod(float dudx, float dvdx, float dudy, float dvdy) const
+    {
+        float w0 = static_cast<float>(mips[0].w), h0 = static_cast<float>(mips[0].h);
+        float lx = (dudx * w0) * (dudx * w0) + (dvdx * h0) * (dvdx * h0);
+        float ly = (dudy * w0) * (dudy * w0) + (dvdy * h0) * (dvdy * h0);
+        float rho2 = std::max(lx, ly);
+        return rho2 > 1.f ? 0.5f * std::log2(rho2) : 0.f;
+    }
+
+    /// @brief Nearest texel of the level closest to `lod`, with repeat wrapping.
+    /*!
+        `v = 0` is the bottom of the image, as in OBJ files.
+     */
+    TGAColor sample(float u, float v, float lod) const
+    {
+        int level = std::min(static_cast<int>(lod + 0.5f), levels() - 1);
+        const Level &m = mips[level];
+        u -= std::floor(u);
+        v -= std::floor(v);
+        int x = std::min(static_cast<int>(u * m.w), m.w - 1);
+        int y = std::min(static_cast<int>((1.f - v) * m.h), m.h - 1);
+        std::uint32_t texel = m.texels[m.index(x, y)];
+        TGAColor c;
+        c.bgra[0] = texel & 0xff;
+        c.bgra[1] = (texel >> 8) & 0xff;
+        c.bgra[2] = (texel >> 16) & 0xff;
+        c.bgra[3] = texel >> 24;
+        return c;
+    }
+
+private:
+    static constexpr int block = 4; ///< Texels per block side.
+
+    struct Level
+    {
+        int w = 0, h = 0;
+        int blocks_x = 0;
+        std::vector<std::uint32_t> texels; ///< BGRA, 4x4 blocks stored row by row.
+
+        size_t index(int x, int y) const
+        {
+            return (static_cast<size_t>(y / block) * blocks_x + x / block) * block * block + (y % block) * block + x % block;
+        }
+    };
+
+    std::vector<Level> mips;
+};
+
+#endif // TEXTURE_H
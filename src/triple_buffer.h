@@ -0,0 +1,50 @@
+/// @file triple_buffer.h
+/// @brief Lock-free latest-value slot between one writer and one reader thread.
+/*!
+    Three copies of `T`: the writer owns one, the reader owns one and the third
+    is the hand-over slot. `publish()` swaps the writer's copy into the slot and
+    `update()` swaps the slot into the reader's copy, each with one atomic
+    exchange. Neither side ever waits for the other; values the reader was too
+    slow to pick up are overwritten, so it always sees the newest one.
+ */
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+    /// @brief Writer side: the copy to fill before `publish()`.
+    T &write_buffer() { return slots[back]; }
+    /// @brief Writer side: hand the filled copy to the reader.
+    void publish()
+    {
+        back = middle.exchange(back | fresh, std::memory_order_acq_rel) & index_mask;
+    }
+
+    /// @brief Reader side: take the newest published value, if any.
+    /// @return True if `read_buffer()` changed.
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & fresh))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+    /// @brief Reader side: the value taken by the last `update()`.
+    const T &read_buffer() const { return slots[front]; }
+
+private:
+    static constexpr unsigned index_mask = 3;
+    static constexpr unsigned fresh = 4; ///< Set in `middle` while it holds an unread value.
+
+    std::array<T, 3> slots{};
+    std::atomic<unsigned> middle{1};
+    unsigned back = 0;  ///< Writer's copy.
+    unsigned front = 2; ///< Reader's copy.
+};
+
+#endif // TRIPLE_BUFFER_H